@@ -1,10 +1,35 @@
+#include <linux/bitops.h>
 #include <linux/errno.h>
+#include <linux/module.h>
 #include <linux/sysfs.h>
 #include <linux/types.h>
 #include <linux/device.h>
 #include <linux/acpi.h>
 #include <linux/leds.h>
-#include <linux/uuid.h>
+#include <linux/platform_profile.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/pm.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/version.h>
+
+#include "samsung_acpi_trace.h"
+
+/*
+ * Build profiles, selected with PROFILE= in the Makefile:
+ * SCAI_DEBUG dumps every SCAI request and response and logs notify events,
+ * SCAI_RECORDER builds the traffic ring buffer behind debugfs trace.
+ * Neither is defined in the production profile. The notify and watchdog
+ * statistics in debugfs are built in both profiles.
+ */
 
 #define SCAI_CSFI_LEN 0x15
 #define SCAI_CSXI_LEN 0x100
@@ -16,10 +41,20 @@
 #define SCAI_SASB_USB_CHARGE       0x68
 #define SCAI_SASB_NOTIFICATION     0x86
 #define SCAI_SASB_WEBCAM_ENABLE    0x8a
+#define SCAI_SASB_PERF_MODE        0x91
 
 #define SCAI_GUNM_SET 0x82
 #define SCAI_GUNM_GET 0x81
 
+#define SCAI_NOTIFY_CODES 0x100
+
+#define SCAI_NOTIFY_BATTERY_STATE 0x61
+#define SCAI_NOTIFY_ON_TABLE      0x6c
+#define SCAI_NOTIFY_OFF_TABLE     0x6d
+#define SCAI_NOTIFY_PERF_MODE     0x70
+
+#define SCAI_METHODS (SCAI_TRACE_SETM + 1)
+
 #define SCAI_PERF_OPTIMIZED_STR   "optimized"
 #define SCAI_PERF_PERFORMANCE_STR "performance"
 #define SCAI_PERF_QUIET_STR       "quiet"
@@ -59,14 +94,336 @@ struct scai_buffer {
 	};
 };
 
+#define SCAI_OFFSET(field) offsetof(struct scai_buffer, field)
+
+/*
+ * Request templates, only the first SCAI_CSFI_LEN or SCAI_CSXI_LEN bytes are
+ * sent to the firmware.
+ */
+#define SCAI_CSFI(_sasb, _gunm, ...) (&(const struct scai_buffer) { \
+	.safn = SCAI_SAFN, .sasb = (_sasb), .gunm = (_gunm), .guds = { __VA_ARGS__ } })
+
+#define SCAI_CSXI_PERF(_subn) (&(const struct scai_buffer) { \
+	.safn = SCAI_SAFN, .sasb = SCAI_SASB_PERF_MODE, .caid = SCAI_CAID_PERFMODE, .fncn = 0x51, .subn = (_subn) })
+
+/* GUID 8246028d-8bca-4a55-ba0f-6f1e6b921b8f, as laid out by export_guid() */
+#define SCAI_CAID_PERFMODE { 0x8d, 0x02, 0x46, 0x82, 0xca, 0x8b, 0x55, 0x4a, 0xba, 0x0f, 0x6f, 0x1e, 0x6b, 0x92, 0x1b, 0x8f }
+
+enum scai_check {
+	SCAI_CHECK_NONE,
+	/* The sub-address acknowledged the enable handshake */
+	SCAI_CHECK_ENABLED,
+	/* The result byte is the argument */
+	SCAI_CHECK_RESULT,
+	/* Either the echo byte of the request or the argument is returned */
+	SCAI_CHECK_ECHO,
+};
+
+/*
+ * A single SCAI command: the argument, if any, is stored at offset arg of the
+ * request and the result is read at offset result of the response.
+ */
+struct scai_command {
+	enum scai_trace_method method;
+	const struct scai_buffer *request;
+	u8 arg;
+	u8 result;
+	u8 echo;
+	enum scai_check check;
+};
+
+struct scai_value_name {
+	u8 value;
+	const char *name;
+};
+
+/* Exposed as the keyboard backlight LED instead of a sysfs attribute */
+#define SCAI_FEATURE_LED  BIT(0)
+/* Any non zero value written to sysfs means 1 */
+#define SCAI_FEATURE_BOOL BIT(1)
+/* Can be changed outside the driver, changes are reported with a uevent */
+#define SCAI_FEATURE_SAMPLED BIT(2)
+
+struct scai_data;
+
+struct scai_feature {
+	const char *name;
+	unsigned int flags;
+	u8 max;
+	/* Time a read may take before the cached value is returned instead */
+	unsigned int budget_ms;
+	/* Returns the mask of supported values, if not all of them are */
+	u32 (*supported)(const struct scai_data *data);
+	/* Names shown in sysfs instead of the values, if any */
+	const struct scai_value_name *names;
+	struct scai_command get;
+	struct scai_command set;
+};
+
+/*
+ * The CSFI sub-addresses are enabled at probe in the order of their first
+ * feature here, which is the order the firmware has always been initialized in.
+ */
+enum scai_feature_id {
+	SCAI_FEATURE_BATTERY_LIFE_EXTENDER,
+	SCAI_FEATURE_AUTOBOOT,
+	SCAI_FEATURE_KB_BACKLIGHT,
+	SCAI_FEATURE_WEBCAM_ENABLE,
+	SCAI_FEATURE_PERF_MODE,
+	SCAI_FEATURES
+};
+
+/*
+ * Reads run in a work item, so that a reader waits for the firmware at most for
+ * the budget of the feature. The last value read or written is kept to answer
+ * readers that ran out of budget. Every write and every sample published bumps
+ * the generation, so that a read started before it cannot bring the old value
+ * back when it completes.
+ */
+struct scai_feature_state {
+	struct scai_data *data;
+	enum scai_feature_id id;
+	struct work_struct work;
+	bool in_flight;
+	int err;
+
+	u8 value;
+	bool valid;
+	bool stale;
+	unsigned int generation;
+
+	/* Last value seen by the sampler or written, for SCAI_FEATURE_SAMPLED */
+	u8 sample;
+	bool sampled;
+
+	u64 last_ns;
+	unsigned long slow;
+	unsigned long stale_reads;
+	unsigned long backoffs;
+	unsigned int consecutive_slow;
+	unsigned long backoff_until;
+};
+
+struct scai_notify_stats {
+	u64 count;
+	u64 coalesced;
+	u64 last_ns;
+	unsigned int rate;
+	unsigned long window_start;
+	unsigned int window_count;
+	bool pending;
+	/* End of the window in which the pending event was coalesced */
+	unsigned long deadline;
+};
+
 struct scai_data {
 	struct acpi_device *acpi_dev;
 	struct led_classdev kb_led;
 
+	acpi_handle methods[SCAI_METHODS];
+
 	u32 supported_perf_modes;
+#if IS_REACHABLE(CONFIG_ACPI_PLATFORM_PROFILE)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0)
+	struct device *profile_dev;
+#else
+	struct platform_profile_handler profile;
+#endif
+	bool profile_registered;
+#endif
+
+	struct device_attribute feature_attrs[SCAI_FEATURES];
+	struct attribute *attrs[SCAI_FEATURES + 2];
+	struct attribute_group attribute_group;
+
+	spinlock_t feature_lock;
+	wait_queue_head_t feature_wait;
+	struct scai_feature_state feature_state[SCAI_FEATURES];
+
+	/* Orders the sample publications and their uevents against the writes */
+	struct mutex sample_lock;
+	unsigned long sample_pending;
+	struct work_struct sample_work;
+
+	spinlock_t notify_lock;
+	struct delayed_work notify_work;
+	/* Earliest deadline of the pending codes, when notify_work is armed */
+	unsigned long notify_deadline;
+	bool notify_armed;
+	struct scai_notify_stats notify_stats[SCAI_NOTIFY_CODES];
+
+	struct dentry *debugfs;
+
+	u64 notify_invalid;
+
+#ifdef SCAI_RECORDER
+	spinlock_t trace_lock;
+	struct scai_trace_record *trace;
+	unsigned int trace_len;
+	u64 trace_seq;
+#endif
 };
 
-static const guid_t SCAI_CAID_PERFMODE = GUID_INIT(0x8246028d, 0x8bca, 0x4a55, 0xba, 0x0f, 0x6f, 0x1e, 0x6b, 0x92, 0x1b, 0x8f);
+static const struct scai_value_name scai_perf_mode_names[] = {
+	{SCAI_PERF_OPTIMIZED, SCAI_PERF_OPTIMIZED_STR},
+	{SCAI_PERF_PERFORMANCE, SCAI_PERF_PERFORMANCE_STR},
+	{SCAI_PERF_QUIET, SCAI_PERF_QUIET_STR},
+	{SCAI_PERF_SILENT, SCAI_PERF_SILENT_STR},
+	{0, NULL}
+};
+
+#if IS_REACHABLE(CONFIG_ACPI_PLATFORM_PROFILE)
+static const struct {
+	enum scai_perf_modes mode;
+	enum platform_profile_option profile;
+} scai_perf_mode_profiles[] = {
+	{SCAI_PERF_OPTIMIZED, PLATFORM_PROFILE_BALANCED},
+	{SCAI_PERF_PERFORMANCE, PLATFORM_PROFILE_PERFORMANCE},
+	{SCAI_PERF_QUIET, PLATFORM_PROFILE_QUIET},
+	{SCAI_PERF_SILENT, PLATFORM_PROFILE_LOW_POWER},
+};
+#endif
+
+static u32 scai_perf_mode_supported(const struct scai_data *data)
+{
+	return data->supported_perf_modes;
+}
+
+static const struct scai_feature scai_features[SCAI_FEATURES] = {
+	[SCAI_FEATURE_BATTERY_LIFE_EXTENDER] = {
+		.name = "battery_life_extender",
+		.flags = SCAI_FEATURE_SAMPLED,
+		.max = 99,
+		.budget_ms = 50,
+		.get = {
+			.method = SCAI_TRACE_CSFI,
+			.request = SCAI_CSFI(SCAI_SASB_POWER_MANAGEMENT, SCAI_GUNM_SET, 0xe9, 0x91),
+			.result = SCAI_OFFSET(guds[1]),
+		},
+		.set = {
+			.method = SCAI_TRACE_CSFI,
+			.request = SCAI_CSFI(SCAI_SASB_POWER_MANAGEMENT, SCAI_GUNM_SET, 0xe9, 0x90),
+			.arg = SCAI_OFFSET(guds[2]),
+			.result = SCAI_OFFSET(guds[2]),
+			.echo = SCAI_OFFSET(guds[1]),
+			.check = SCAI_CHECK_ECHO,
+		},
+	},
+	[SCAI_FEATURE_AUTOBOOT] = {
+		.name = "autoboot",
+		.flags = SCAI_FEATURE_BOOL | SCAI_FEATURE_SAMPLED,
+		.max = 1,
+		.budget_ms = 50,
+		.get = {
+			.method = SCAI_TRACE_CSFI,
+			.request = SCAI_CSFI(SCAI_SASB_POWER_MANAGEMENT, SCAI_GUNM_SET, 0xa3, 0x81),
+			.result = SCAI_OFFSET(guds[1]),
+		},
+		.set = {
+			.method = SCAI_TRACE_CSFI,
+			.request = SCAI_CSFI(SCAI_SASB_POWER_MANAGEMENT, SCAI_GUNM_SET, 0xa3, 0x80),
+			.arg = SCAI_OFFSET(guds[2]),
+			.result = SCAI_OFFSET(guds[2]),
+			.echo = SCAI_OFFSET(guds[1]),
+			.check = SCAI_CHECK_ECHO,
+		},
+	},
+	[SCAI_FEATURE_KB_BACKLIGHT] = {
+		.name = "scai::kbd_backlight",
+		.flags = SCAI_FEATURE_LED,
+		.max = 3,
+		.budget_ms = 50,
+		.get = {
+			.method = SCAI_TRACE_CSFI,
+			.request = SCAI_CSFI(SCAI_SASB_KB_BACKLIGHT, SCAI_GUNM_GET),
+			.result = SCAI_OFFSET(gunm),
+		},
+		.set = {
+			.method = SCAI_TRACE_CSFI,
+			.request = SCAI_CSFI(SCAI_SASB_KB_BACKLIGHT, SCAI_GUNM_SET),
+			.arg = SCAI_OFFSET(guds[0]),
+		},
+	},
+	[SCAI_FEATURE_WEBCAM_ENABLE] = {
+		.name = "webcam_enable",
+		.max = 1,
+		.budget_ms = 50,
+		.get = {
+			.method = SCAI_TRACE_CSFI,
+			.request = SCAI_CSFI(SCAI_SASB_WEBCAM_ENABLE, SCAI_GUNM_GET),
+			.result = SCAI_OFFSET(gunm),
+		},
+		.set = {
+			.method = SCAI_TRACE_CSFI,
+			.request = SCAI_CSFI(SCAI_SASB_WEBCAM_ENABLE, SCAI_GUNM_SET),
+			.arg = SCAI_OFFSET(guds[0]),
+			.result = SCAI_OFFSET(gunm),
+			.check = SCAI_CHECK_RESULT,
+		},
+	},
+	[SCAI_FEATURE_PERF_MODE] = {
+		.name = "perf_mode",
+		.max = SCAI_PERF_SILENT,
+		.budget_ms = 100,
+		.supported = scai_perf_mode_supported,
+		.names = scai_perf_mode_names,
+		.get = {
+			.method = SCAI_TRACE_CSXI,
+			.request = SCAI_CSXI_PERF(0x02),
+			.result = SCAI_OFFSET(iob0),
+		},
+		.set = {
+			.method = SCAI_TRACE_CSXI,
+			.request = SCAI_CSXI_PERF(0x03),
+			.arg = SCAI_OFFSET(iob0),
+		},
+	},
+};
+
+static const struct scai_command scai_cmd_enable = {
+	.method = SCAI_TRACE_CSFI,
+	.request = SCAI_CSFI(0, 0xbb, 0xaa),
+	.check = SCAI_CHECK_ENABLED,
+};
+
+static const struct scai_command scai_cmd_notification = {
+	.method = SCAI_TRACE_CSFI,
+	.request = SCAI_CSFI(SCAI_SASB_NOTIFICATION, 0x80, 0x02),
+};
+
+static const struct scai_command scai_cmd_perf_mode_supported = {
+	.method = SCAI_TRACE_CSXI,
+	.request = SCAI_CSXI_PERF(0x00),
+};
+
+static unsigned int notify_burst = 8;
+module_param(notify_burst, uint, 0644);
+MODULE_PARM_DESC(notify_burst, "Notify events of the same code handled per interval, the rest are coalesced (0 = no limit)");
+
+static unsigned int notify_interval_ms = 1000;
+module_param(notify_interval_ms, uint, 0644);
+MODULE_PARM_DESC(notify_interval_ms, "Length of the notify rate limiting interval in milliseconds");
+
+static unsigned int slow_limit = 3;
+module_param(slow_limit, uint, 0644);
+MODULE_PARM_DESC(slow_limit, "Consecutive reads over budget after which the firmware is not asked for a while (0 = never back off)");
+
+static unsigned int slow_backoff_ms = 10000;
+module_param(slow_backoff_ms, uint, 0644);
+MODULE_PARM_DESC(slow_backoff_ms, "Time during which reads of a misbehaving feature are answered from the cache, in milliseconds");
+
+#ifdef SCAI_RECORDER
+static unsigned int trace_records = 64;
+module_param(trace_records, uint, 0444);
+MODULE_PARM_DESC(trace_records, "Size of the SCAI traffic ring buffer in debugfs, in records (0 = disabled)");
+#endif
+
+static const char * const scai_methods[SCAI_METHODS] = {
+	[SCAI_TRACE_CSFI] = "CSFI",
+	[SCAI_TRACE_CSXI] = "CSXI",
+	[SCAI_TRACE_SDLS] = "SDLS",
+	[SCAI_TRACE_SETM] = "SETM",
+};
 
 static const struct acpi_device_id device_ids[] = {
 	{"SAM0428", 0},
@@ -74,25 +431,82 @@ static const struct acpi_device_id device_ids[] = {
 };
 MODULE_DEVICE_TABLE(acpi, device_ids);
 
-static int scai_command_integer(struct scai_data *data, acpi_string pathname, u64 arg, u64 *ret)
+#ifdef SCAI_RECORDER
+/*
+ * Records a command in the trace ring buffer, overwriting the oldest record
+ * when full. request and response are NULL for the integer methods.
+ */
+static void scai_trace(struct scai_data *data, enum scai_trace_method method, u64 start_ns,
+		       enum scai_trace_status status, u64 arg, const void *request, const void *response, u16 len)
+{
+	struct scai_trace_record *rec;
+	u64 now = ktime_get_ns();
+	u32 slot;
+
+	if (!data->trace)
+		return;
+
+	spin_lock(&data->trace_lock);
+
+	div_u64_rem(data->trace_seq, data->trace_len, &slot);
+	rec = &data->trace[slot];
+	rec->seq = data->trace_seq++;
+	rec->timestamp_ns = start_ns;
+	rec->latency_ns = min_t(u64, now - start_ns, U32_MAX);
+	rec->method = method;
+	rec->status = status;
+	rec->len = len;
+	rec->arg = arg;
+
+	if (request)
+		memcpy(rec->request, request, len);
+
+	if (response)
+		memcpy(rec->response, response, len);
+	else
+		memset(rec->response, 0, len);
+
+	spin_unlock(&data->trace_lock);
+}
+
+static u64 scai_trace_start(void)
+{
+	return ktime_get_ns();
+}
+#else
+static inline void scai_trace(struct scai_data *data, enum scai_trace_method method, u64 start_ns,
+			      enum scai_trace_status status, u64 arg, const void *request, const void *response, u16 len)
+{
+}
+
+static inline u64 scai_trace_start(void)
+{
+	return 0;
+}
+#endif
+
+static int scai_command_integer(struct scai_data *data, enum scai_trace_method method, u64 arg, u64 *ret)
 {
 	union acpi_object int_obj, *ret_obj;
 	struct acpi_object_list obj_list;
 	struct acpi_buffer ret_buffer = {ACPI_ALLOCATE_BUFFER, NULL};
-	acpi_handle object;
 	acpi_status status;
+	u64 start;
 
 	obj_list.count = 1;
 	obj_list.pointer = &int_obj;
 	int_obj.type = ACPI_TYPE_INTEGER;
 	int_obj.integer.value = arg;
 
-	object = acpi_device_handle(data->acpi_dev);
+	start = scai_trace_start();
 
 	if (ret == NULL)
-		status = acpi_evaluate_object(object, pathname, &obj_list, NULL);
+		status = acpi_evaluate_object(data->methods[method], NULL, &obj_list, NULL);
 	else
-		status = acpi_evaluate_object(object, pathname, &obj_list, &ret_buffer);
+		status = acpi_evaluate_object(data->methods[method], NULL, &obj_list, &ret_buffer);
+
+	scai_trace(data, method, start, ACPI_SUCCESS(status) ? SCAI_TRACE_OK : SCAI_TRACE_FAILED,
+		   arg, NULL, NULL, 0);
 
 	if (ACPI_SUCCESS(status)) {
 		if (ret) {
@@ -112,13 +526,13 @@ static int scai_command_integer(struct scai_data *data, acpi_string pathname, u6
 		return -1;
 }
 
-static int scai_command_complex(struct scai_data *data, acpi_string pathname, struct scai_buffer *buf, struct scai_buffer *ret, u32 len)
+static int scai_command_complex(struct scai_data *data, enum scai_trace_method method, struct scai_buffer *buf, struct scai_buffer *ret, u32 len)
 {
 	union acpi_object buf_obj, *ret_obj;
 	struct acpi_object_list obj_list;
 	struct acpi_buffer ret_buffer = {ACPI_ALLOCATE_BUFFER, NULL};
-	acpi_handle object;
 	acpi_status status;
+	u64 start;
 
 	obj_list.count = 1;
 	obj_list.pointer = &buf_obj;
@@ -126,42 +540,54 @@ static int scai_command_complex(struct scai_data *data, acpi_string pathname, st
 	buf_obj.buffer.length = len;
 	buf_obj.buffer.pointer = (u8 *) buf;
 
-	object = acpi_device_handle(data->acpi_dev);
-	status = acpi_evaluate_object(object, pathname, &obj_list, &ret_buffer);
+	start = scai_trace_start();
+	status = acpi_evaluate_object(data->methods[method], NULL, &obj_list, &ret_buffer);
 
 	if (ACPI_SUCCESS(status)) {
 		ret_obj = ret_buffer.pointer;
 
 		if (ret_obj->type != ACPI_TYPE_BUFFER) {
+			scai_trace(data, method, start, SCAI_TRACE_FAILED, 0, buf, NULL, len);
 			pr_err("scai_command_complex: response is not a buffer\n");
 			return -1;
 		}
 
 		if (ret_obj->buffer.length != len) {
+			scai_trace(data, method, start, SCAI_TRACE_FAILED, 0, buf, NULL, len);
 			pr_err("scai_command_complex: response length mismatch\n");
 			return -1;
 		}
 
+		scai_trace(data, method, start, SCAI_TRACE_OK, 0, buf, ret_obj->buffer.pointer, len);
+
 		memcpy(ret, ret_obj->buffer.pointer, len);
 		kfree(ret_buffer.pointer);
 
 		return 0;
-	} else
+	} else {
+		scai_trace(data, method, start, SCAI_TRACE_FAILED, 0, buf, NULL, len);
 		return -1;
+	}
 }
 
 static int scai_csfi_command(struct scai_data *data, struct scai_buffer *buf)
 {
 	int ret;
+#ifdef SCAI_DEBUG
 	u8 *buff = (u8 *) buf;
+#endif
 
+#ifdef SCAI_DEBUG
 	pr_info("scai_csfi_command request:  0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n",
 		buff[0], buff[1], buff[2], buff[3], buff[4], buff[5], buff[6], buff[7], buff[8], buff[9], buff[10], buff[11], buff[12], buff[13], buff[14], buff[15], buff[16], buff[17], buff[18], buff[19], buff[20]);
+#endif
 
-	ret = scai_command_complex(data, "CSFI", buf, buf, SCAI_CSFI_LEN);
+	ret = scai_command_complex(data, SCAI_TRACE_CSFI, buf, buf, SCAI_CSFI_LEN);
 
+#ifdef SCAI_DEBUG
 	pr_info("scai_csfi_command response: 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n",
 		buff[0], buff[1], buff[2], buff[3], buff[4], buff[5], buff[6], buff[7], buff[8], buff[9], buff[10], buff[11], buff[12], buff[13], buff[14], buff[15], buff[16], buff[17], buff[18], buff[19], buff[20]);
+#endif
 
 	if (ret != 0) {
 		pr_err("scai_csfi_command: command failed\n");
@@ -179,8 +605,11 @@ static int scai_csfi_command(struct scai_data *data, struct scai_buffer *buf)
 static int scai_csxi_command(struct scai_data *data, struct scai_buffer *buf)
 {
 	int ret;
+#ifdef SCAI_DEBUG
 	u8 *buff = (u8 *) buf;
+#endif
 
+#ifdef SCAI_DEBUG
 	pr_info("scai_csxi_command request: "
 		"0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x "
 		"0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x "
@@ -188,9 +617,11 @@ static int scai_csxi_command(struct scai_data *data, struct scai_buffer *buf)
 		buff[0x0], buff[0x1], buff[0x2], buff[0x3], buff[0x4], buff[0x5], buff[0x6], buff[0x7], buff[0x8], buff[0x9], buff[0xA], buff[0xB], buff[0xC], buff[0xD], buff[0xE], buff[0xF],
 		buff[0x10], buff[0x11], buff[0x12], buff[0x13], buff[0x14], buff[0x15], buff[0x16], buff[0x17], buff[0x18], buff[0x19], buff[0x1A], buff[0x1B], buff[0x1C], buff[0x1D], buff[0x1E], buff[0x1F],
 		buff[0x20], buff[0x21], buff[0x22], buff[0x23], buff[0x24], buff[0x25], buff[0x26], buff[0x27], buff[0x28], buff[0x29], buff[0x2A], buff[0x2B], buff[0x2C], buff[0x2D], buff[0x2E], buff[0x2F]);
+#endif
 
-	ret = scai_command_complex(data, "CSXI", buf, buf, SCAI_CSXI_LEN);
+	ret = scai_command_complex(data, SCAI_TRACE_CSXI, buf, buf, SCAI_CSXI_LEN);
 
+#ifdef SCAI_DEBUG
 	pr_info("scai_csxi_command response: "
 		"0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x "
 		"0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x "
@@ -198,6 +629,7 @@ static int scai_csxi_command(struct scai_data *data, struct scai_buffer *buf)
 		buff[0x0], buff[0x1], buff[0x2], buff[0x3], buff[0x4], buff[0x5], buff[0x6], buff[0x7], buff[0x8], buff[0x9], buff[0xA], buff[0xB], buff[0xC], buff[0xD], buff[0xE], buff[0xF],
 		buff[0x10], buff[0x11], buff[0x12], buff[0x13], buff[0x14], buff[0x15], buff[0x16], buff[0x17], buff[0x18], buff[0x19], buff[0x1A], buff[0x1B], buff[0x1C], buff[0x1D], buff[0x1E], buff[0x1F],
 		buff[0x20], buff[0x21], buff[0x22], buff[0x23], buff[0x24], buff[0x25], buff[0x26], buff[0x27], buff[0x28], buff[0x29], buff[0x2A], buff[0x2B], buff[0x2C], buff[0x2D], buff[0x2E], buff[0x2F]);
+#endif
 
 	if (ret != 0) {
 		pr_err("scai_csxi_command: command failed\n");
@@ -213,225 +645,389 @@ static int scai_csxi_command(struct scai_data *data, struct scai_buffer *buf)
 
 }
 
-static int scai_enable_csfi_command(struct scai_data *data, u16 sasb)
+static u32 scai_command_len(const struct scai_command *cmd)
+{
+	return cmd->method == SCAI_TRACE_CSXI ? SCAI_CSXI_LEN : SCAI_CSFI_LEN;
+}
+
+static void scai_prepare(const struct scai_command *cmd, struct scai_buffer *buf)
+{
+	memcpy(buf, cmd->request, scai_command_len(cmd));
+}
+
+/*
+ * Sends a prepared request and validates the response, which is left in buf.
+ */
+static int scai_run(struct scai_data *data, const struct scai_command *cmd, struct scai_buffer *buf, u8 arg)
 {
+	const u8 *request = (const u8 *) cmd->request;
+	u8 *response = (u8 *) buf;
 	int err;
-	struct scai_buffer buf = {0};
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = sasb;
-	buf.gunm = 0xbb;
-	buf.guds[0] = 0xaa;
+	if (cmd->arg)
+		response[cmd->arg] = arg;
+
+	if (cmd->method == SCAI_TRACE_CSXI)
+		err = scai_csxi_command(data, buf);
+	else
+		err = scai_csfi_command(data, buf);
 
-	err = scai_csfi_command(data, &buf);
 	if (err)
 		return err;
 
-	if (buf.gunm != 0xdd && buf.guds[0] != 0xcc)
-		return -ENODEV;
+	switch (cmd->check) {
+		case SCAI_CHECK_NONE:
+			break;
+		case SCAI_CHECK_ENABLED:
+			if (buf->gunm != 0xdd && buf->guds[0] != 0xcc)
+				return -ENODEV;
+			break;
+		case SCAI_CHECK_RESULT:
+			if (response[cmd->result] != arg)
+				goto invalid;
+			break;
+		case SCAI_CHECK_ECHO:
+			if (response[cmd->echo] != request[cmd->echo] && response[cmd->result] != arg)
+				goto invalid;
+			break;
+	}
 
 	return 0;
+
+invalid:
+	pr_err("scai_run: invalid response for sasb 0x%02x\n", buf->sasb);
+	return -EINVAL;
 }
 
-static int scai_notification_set(struct scai_data *data)
+static int scai_execute(struct scai_data *data, const struct scai_command *cmd, u8 arg, u8 *result)
 {
+	struct scai_buffer buf;
 	int err;
-	struct scai_buffer buf = {0};
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = SCAI_SASB_NOTIFICATION;
-	buf.gunm = 0x80;
-	buf.guds[0] = 0x02;
+	scai_prepare(cmd, &buf);
 
-	err = scai_csfi_command(data, &buf);
+	err = scai_run(data, cmd, &buf, arg);
 	if (err)
 		return err;
 
+	if (result)
+		*result = ((u8 *) &buf)[cmd->result];
+
 	return 0;
 }
 
-static int scai_kb_backlight_set(struct scai_data *data, u8 value)
+static int scai_enable_csfi_command(struct scai_data *data, u16 sasb)
 {
-	struct scai_buffer buf = {0};
+	struct scai_buffer buf;
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = SCAI_SASB_KB_BACKLIGHT;
-	buf.gunm = SCAI_GUNM_SET;
-	buf.guds[0] = value;
+	scai_prepare(&scai_cmd_enable, &buf);
+	buf.sasb = sasb;
 
-	return scai_csfi_command(data, &buf);
+	return scai_run(data, &scai_cmd_enable, &buf, 0);
 }
 
-static int scai_kb_backlight_get(struct scai_data *data, u8 *value)
+static int scai_notification_set(struct scai_data *data)
 {
-	int err;
-	struct scai_buffer buf = {0};
+	return scai_execute(data, &scai_cmd_notification, 0, NULL);
+}
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = SCAI_SASB_KB_BACKLIGHT;
-	buf.gunm = SCAI_GUNM_GET;
+static int scai_feature_get(struct scai_data *data, enum scai_feature_id id, u8 *value)
+{
+	return scai_execute(data, &scai_features[id].get, 0, value);
+}
 
-	err = scai_csfi_command(data, &buf);
-	if (err)
-		return err;
+/*
+ * Records the current value of a sampled feature and, when it differs from the
+ * previous one, tells the listeners with a change uevent carrying the feature
+ * name and the new value, e.g. SCAI_CHANGED=autoboot SCAI_VALUE=1. generation
+ * is the one seen before the value was read, a value that lost the race with a
+ * write is dropped. Called with sample_lock held.
+ */
+static void scai_sample_update(struct scai_data *data, enum scai_feature_id id, u8 value,
+			       unsigned int generation)
+{
+	struct scai_feature_state *state = &data->feature_state[id];
+	char changed_env[48], value_env[16];
+	char *envp[] = {changed_env, value_env, NULL};
+	bool changed;
 
-	*value = buf.gunm;
+	spin_lock(&data->feature_lock);
 
-	return 0;
+	if (generation != state->generation) {
+		spin_unlock(&data->feature_lock);
+		return;
+	}
+
+	changed = state->sampled && state->sample != value;
+	state->sample = value;
+	state->sampled = true;
+	state->value = value;
+	state->valid = true;
+	state->generation++;
+
+	spin_unlock(&data->feature_lock);
+
+	if (!changed)
+		return;
+
+	snprintf(changed_env, sizeof(changed_env), "SCAI_CHANGED=%s", scai_features[id].name);
+	snprintf(value_env, sizeof(value_env), "SCAI_VALUE=%u", value);
+
+	sysfs_notify(&data->acpi_dev->dev.kobj, NULL, scai_features[id].name);
+	kobject_uevent_env(&data->acpi_dev->dev.kobj, KOBJ_CHANGE, envp);
 }
 
-static int scai_battery_life_extender_set(struct scai_data *data, u8 value)
+/*
+ * Rereads the features that can change behind the driver's back (BIOS setup,
+ * other OS). Runs once at probe to get the baseline, after resume and after
+ * the notify events that may follow such a change, so that nobody has to poll
+ * them.
+ */
+static void scai_sample_work(struct work_struct *work)
 {
-	int err;
-	struct scai_buffer buf = {0};
+	struct scai_data *data = container_of(work, struct scai_data, sample_work);
+	unsigned int generation;
+	int err, i;
+	u8 value;
 
-	if (value >= 100)
-		return -EINVAL;
+	for (i = 0; i < SCAI_FEATURES; i++) {
+		if (!test_and_clear_bit(i, &data->sample_pending))
+			continue;
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = SCAI_SASB_POWER_MANAGEMENT;
-	buf.gunm = SCAI_GUNM_SET;
-	buf.guds[0] = 0xe9;
-	buf.guds[1] = 0x90;
-	buf.guds[2] = value;
+		spin_lock(&data->feature_lock);
+		generation = data->feature_state[i].generation;
+		spin_unlock(&data->feature_lock);
 
-	err = scai_csfi_command(data, &buf);
-	if (err)
-		return err;
+		/* The firmware may be slow, writers do not wait for the read */
+		err = scai_feature_get(data, i, &value);
+		if (err) {
+			pr_warn_ratelimited("scai_sample_work: failed to read %s\n", scai_features[i].name);
+			continue;
+		}
 
-	if (buf.guds[1] != 0x90 && buf.guds[2] != value) {
-		pr_err("scai_battery_safe_set: invalid response");
-		return -EINVAL;
+		mutex_lock(&data->sample_lock);
+		scai_sample_update(data, i, value, generation);
+		mutex_unlock(&data->sample_lock);
 	}
-
-	return 0;
 }
 
-static int scai_battery_life_extender_get(struct scai_data *data, u8 *value)
+/*
+ * Queues a sample of the given features, the ones that are not sampled are
+ * ignored. The firmware may hang, so the sampler does not run on system_wq.
+ */
+static void scai_sample_queue(struct scai_data *data, unsigned long features)
 {
-	int err;
-	struct scai_buffer buf = {0};
+	int i;
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = SCAI_SASB_POWER_MANAGEMENT;
-	buf.gunm = 0x82;
-	buf.guds[0] = 0xe9;
-	buf.guds[1] = 0x91;
-
-	err = scai_csfi_command(data, &buf);
-	if (err)
-		return err;
-
-	*value = buf.guds[1];
+	for (i = 0; i < SCAI_FEATURES; i++) {
+		if ((scai_features[i].flags & SCAI_FEATURE_SAMPLED) && (features & BIT(i)))
+			set_bit(i, &data->sample_pending);
+	}
 
-	return 0;
+	queue_work(system_unbound_wq, &data->sample_work);
 }
 
-static int scai_autoboot_set(struct scai_data *data, u8 value)
+static int scai_feature_set(struct scai_data *data, enum scai_feature_id id, u8 value)
 {
+	const struct scai_feature *feature = &scai_features[id];
+	bool sampled = feature->flags & SCAI_FEATURE_SAMPLED;
+	struct scai_feature_state *state = &data->feature_state[id];
+	unsigned int generation;
 	int err;
-	struct scai_buffer buf = {0};
 
-	if (value != 1 && value != 0)
+	if (value > feature->max)
+		return -EINVAL;
+
+	if (feature->supported && !(feature->supported(data) & BIT(value)))
 		return -EINVAL;
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = SCAI_SASB_POWER_MANAGEMENT;
-	buf.gunm = SCAI_GUNM_SET;
-	buf.guds[0] = 0xa3;
-	buf.guds[1] = 0x80;
-	buf.guds[2] = value;
+	if (sampled)
+		mutex_lock(&data->sample_lock);
 
-	err = scai_csfi_command(data, &buf);
+	err = scai_execute(data, &feature->set, value, NULL);
 	if (err)
-		return err;
+		goto out;
 
-	if (buf.guds[1] != 0x80 && buf.guds[2] != value) {
-		pr_err("scai_autoboot_set: invalid response");
-		return -EINVAL;
+	spin_lock(&data->feature_lock);
+
+	if (sampled) {
+		/* Only bumped under sample_lock, scai_sample_update() bumps it */
+		generation = state->generation;
+	} else {
+		state->value = value;
+		state->valid = true;
+		state->generation++;
 	}
 
-	return 0;
+	spin_unlock(&data->feature_lock);
+
+	if (sampled)
+		scai_sample_update(data, id, value, generation);
+
+out:
+	if (sampled)
+		mutex_unlock(&data->sample_lock);
+
+	return err;
 }
 
-static int scai_autoboot_get(struct scai_data *data, u8 *value)
+static void scai_feature_work(struct work_struct *work)
 {
+	struct scai_feature_state *state = container_of(work, struct scai_feature_state, work);
+	struct scai_data *data = state->data;
+	unsigned int budget_ms = scai_features[state->id].budget_ms;
+	unsigned int generation;
+	u64 start, elapsed;
 	int err;
-	struct scai_buffer buf = {0};
+	u8 value;
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = SCAI_SASB_POWER_MANAGEMENT;
-	buf.gunm = SCAI_GUNM_SET;
-	buf.guds[0] = 0xa3;
-	buf.guds[1] = 0x81;
+	spin_lock(&data->feature_lock);
+	generation = state->generation;
+	spin_unlock(&data->feature_lock);
 
-	err = scai_csfi_command(data, &buf);
-	if (err)
-		return err;
+	start = ktime_get_ns();
+	err = scai_feature_get(data, state->id, &value);
+	elapsed = ktime_get_ns() - start;
 
-	*value = buf.guds[1];
+	spin_lock(&data->feature_lock);
 
-	return 0;
+	if (generation != state->generation) {
+		/* Written meanwhile, the cached value is newer than this read */
+		state->err = 0;
+	} else {
+		state->err = err;
+		if (!err) {
+			state->value = value;
+			state->valid = true;
+		}
+	}
+
+	state->last_ns = elapsed;
+
+	if (elapsed > (u64) budget_ms * NSEC_PER_MSEC) {
+		state->slow++;
+		state->consecutive_slow++;
+
+		if (slow_limit && state->consecutive_slow >= slow_limit) {
+			state->backoff_until = jiffies + msecs_to_jiffies(slow_backoff_ms);
+			state->consecutive_slow = 0;
+			state->backoffs++;
+		}
+	} else {
+		state->consecutive_slow = 0;
+	}
+
+	state->in_flight = false;
+
+	spin_unlock(&data->feature_lock);
+
+	wake_up_all(&data->feature_wait);
 }
 
-static int scai_webcam_enable_set(struct scai_data *data, u8 value)
+/*
+ * Reads a feature within its latency budget. When the firmware is slower than
+ * that, or has been repeatedly slow recently, the last known value is returned
+ * and the feature is flagged as stale until a read completes in time again.
+ */
+static int scai_feature_read(struct scai_data *data, enum scai_feature_id id, u8 *value)
 {
-	int err;
-	struct scai_buffer buf = {0};
+	struct scai_feature_state *state = &data->feature_state[id];
+	unsigned long budget = msecs_to_jiffies(scai_features[id].budget_ms);
+	bool was_stale;
+	int err = 0;
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = SCAI_SASB_WEBCAM_ENABLE;
-	buf.gunm = SCAI_GUNM_SET;
-	buf.guds[0] = value;
+	spin_lock(&data->feature_lock);
+
+	was_stale = state->stale;
+
+	if (state->valid && state->backoff_until && time_before(jiffies, state->backoff_until))
+		goto stale;
+
+	if (!state->in_flight) {
+		state->in_flight = true;
+		queue_work(system_unbound_wq, &state->work);
+	}
+
+	spin_unlock(&data->feature_lock);
+
+	wait_event_timeout(data->feature_wait, !READ_ONCE(state->in_flight), budget);
+
+	spin_lock(&data->feature_lock);
+
+	if (!state->in_flight) {
+		err = state->err;
+		if (!err) {
+			*value = state->value;
+			state->stale = false;
+		}
+
+		spin_unlock(&data->feature_lock);
+
+		if (was_stale && !err)
+			sysfs_notify(&data->acpi_dev->dev.kobj, NULL, "stale");
 
-	err = scai_csfi_command(data, &buf);
-	if (err)
 		return err;
+	}
 
-	if (buf.gunm != value) {
-		pr_err("scai_webcam_enable_set: invalid response");
-		return -EINVAL;
+	if (!state->valid) {
+		spin_unlock(&data->feature_lock);
+		return -ETIMEDOUT;
 	}
 
-	return 0;
+stale:
+	*value = state->value;
+	state->stale = true;
+	state->stale_reads++;
+
+	spin_unlock(&data->feature_lock);
+
+	if (!was_stale)
+		sysfs_notify(&data->acpi_dev->dev.kobj, NULL, "stale");
+
+	pr_warn_ratelimited("scai_feature_read: %s is slow, returning the cached value\n", scai_features[id].name);
+
+	return err;
 }
 
-static int scai_webcam_enable_get(struct scai_data *data, u8 *value)
+static void scai_feature_state_init(struct scai_data *data)
 {
-	int err;
-	struct scai_buffer buf = {0};
+	int i;
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = SCAI_SASB_WEBCAM_ENABLE;
-	buf.gunm = SCAI_GUNM_GET;
+	spin_lock_init(&data->feature_lock);
+	init_waitqueue_head(&data->feature_wait);
 
-	err = scai_csfi_command(data, &buf);
-	if (err)
-		return err;
+	for (i = 0; i < SCAI_FEATURES; i++) {
+		data->feature_state[i].data = data;
+		data->feature_state[i].id = i;
+		INIT_WORK(&data->feature_state[i].work, scai_feature_work);
+	}
+}
 
-	*value = buf.gunm;
+static void scai_feature_state_exit(struct scai_data *data)
+{
+	int i;
 
-	return 0;
+	for (i = 0; i < SCAI_FEATURES; i++)
+		cancel_work_sync(&data->feature_state[i].work);
+}
+
+/*
+ * A read may still be running when the probe fails after registering the LED,
+ * whose registration already reads the brightness.
+ */
+static void scai_feature_state_release(void *data)
+{
+	scai_feature_state_exit(data);
 }
 
 static int scai_perf_mode_get_supported(struct scai_data *data)
 {
 	int err;
-	struct scai_buffer buf = {0};
-
-	buf.safn = SCAI_SAFN;
-	buf.sasb = 0x91;
-	export_guid(buf.caid, &SCAI_CAID_PERFMODE);
-	buf.fncn = 0x51;
-	buf.subn = 0x00;
+	struct scai_buffer buf;
 
-	// buf.safn = SCAI_SAFN;
-	// buf.sasb = 0x91;
-	// export_guid(buf.caid, &SCAI_CAID_PERFMODE);
-	// buf.fncn = 0x51;
-	// buf.subn = 0x01;
+	scai_prepare(&scai_cmd_perf_mode_supported, &buf);
 
-	err = scai_csxi_command(data, &buf);
+	err = scai_run(data, &scai_cmd_perf_mode_supported, &buf, 0);
 	if (err)
 		return err;
 
@@ -447,264 +1043,695 @@ static int scai_perf_mode_get_supported(struct scai_data *data)
 	return 0;
 }
 
-static int scai_perf_mode_set(struct scai_data *data, enum scai_perf_modes mode)
+/*
+ * Every CSFI sub-address used by a feature has to be enabled once, in table
+ * order, then the notifications.
+ */
+static int scai_init(struct scai_data *data)
 {
-	int err;
-	struct scai_buffer buf = {0};
+	u16 enabled[SCAI_FEATURES];
+	int err, i, j, count = 0;
+	u16 sasb;
 
-	if (!(data->supported_perf_modes & (1 << mode)))
-		return -EINVAL;
+	for (i = 0; i < SCAI_FEATURES; i++) {
+		if (scai_features[i].get.method != SCAI_TRACE_CSFI)
+			continue;
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = 0x91;
-	export_guid(buf.caid, &SCAI_CAID_PERFMODE);
-	buf.fncn = 0x51;
-	buf.subn = 0x03;
-	buf.iob0 = mode;
+		sasb = scai_features[i].get.request->sasb;
 
-	err = scai_csxi_command(data, &buf);
+		for (j = 0; j < count && enabled[j] != sasb; j++)
+			;
+		if (j < count)
+			continue;
+
+		err = scai_enable_csfi_command(data, sasb);
+		if (err)
+			return err;
+
+		enabled[count++] = sasb;
+	}
+
+	err = scai_enable_csfi_command(data, SCAI_SASB_NOTIFICATION);
+	if (err)
+		return err;
+
+	err = scai_perf_mode_get_supported(data);
 	if (err)
 		return err;
 
 	return 0;
 }
 
-static int scai_perf_mode_get(struct scai_data *data, enum scai_perf_modes *mode)
+/*
+ * Looks up the SCAI methods once, so that commands don't walk the namespace
+ * every time. All of them take a single argument.
+ */
+static int scai_resolve_methods(struct scai_data *data)
 {
-	int err;
-	struct scai_buffer buf = {0};
+	struct acpi_device_info *info;
+	acpi_handle object;
+	acpi_status status;
+	bool valid;
+	int i;
 
-	buf.safn = SCAI_SAFN;
-	buf.sasb = 0x91;
-	export_guid(buf.caid, &SCAI_CAID_PERFMODE);
-	buf.fncn = 0x51;
-	buf.subn = 0x02;
+	object = acpi_device_handle(data->acpi_dev);
 
-	err = scai_csxi_command(data, &buf);
-	if (err)
-		return err;
+	for (i = 0; i < SCAI_METHODS; i++) {
+		status = acpi_get_handle(object, (acpi_string) scai_methods[i], &data->methods[i]);
+		if (ACPI_FAILURE(status)) {
+			pr_err("scai_resolve_methods: method %s not found\n", scai_methods[i]);
+			return -ENODEV;
+		}
 
-	*mode = buf.iob0;
+		status = acpi_get_object_info(data->methods[i], &info);
+		if (ACPI_FAILURE(status)) {
+			pr_err("scai_resolve_methods: cannot get info of %s\n", scai_methods[i]);
+			return -ENODEV;
+		}
+
+		valid = info->type == ACPI_TYPE_METHOD && info->param_count == 1;
+		kfree(info);
+
+		if (!valid) {
+			pr_err("scai_resolve_methods: %s is not a method taking one argument\n", scai_methods[i]);
+			return -ENODEV;
+		}
+	}
 
 	return 0;
 }
 
-static int scai_init(struct scai_data *data)
+static int scai_enable(struct scai_data *data)
 {
-	int err;
+	return scai_command_integer(data, SCAI_TRACE_SDLS, 1, NULL);
+}
 
-	err = scai_enable_csfi_command(data, SCAI_SASB_POWER_MANAGEMENT);
-	if (err)
-		return err;
+static int scai_disable(struct scai_data *data)
+{
+	return scai_command_integer(data, SCAI_TRACE_SDLS, 0, NULL);
+}
 
-	err = scai_enable_csfi_command(data, SCAI_SASB_KB_BACKLIGHT);
-	if (err)
-		return err;
+#if IS_REACHABLE(CONFIG_ACPI_PLATFORM_PROFILE)
+static int scai_profile_read(struct scai_data *data, enum platform_profile_option *profile)
+{
+	int err, i;
+	u8 mode;
 
-	err = scai_enable_csfi_command(data, SCAI_SASB_WEBCAM_ENABLE);
+	err = scai_feature_read(data, SCAI_FEATURE_PERF_MODE, &mode);
 	if (err)
 		return err;
 
-	err = scai_enable_csfi_command(data, SCAI_SASB_NOTIFICATION);
-	if (err)
-		return err;
+	for (i = 0; i < ARRAY_SIZE(scai_perf_mode_profiles); i++) {
+		if (scai_perf_mode_profiles[i].mode == mode) {
+			*profile = scai_perf_mode_profiles[i].profile;
+			return 0;
+		}
+	}
 
-	err = scai_perf_mode_get_supported(data);
+	return -EINVAL;
+}
+
+static int scai_profile_write(struct scai_data *data, enum platform_profile_option profile)
+{
+	int err, i;
+
+	for (i = 0; i < ARRAY_SIZE(scai_perf_mode_profiles); i++) {
+		if (scai_perf_mode_profiles[i].profile == profile)
+			break;
+	}
+
+	if (i == ARRAY_SIZE(scai_perf_mode_profiles))
+		return -EOPNOTSUPP;
+
+	err = scai_feature_set(data, SCAI_FEATURE_PERF_MODE, scai_perf_mode_profiles[i].mode);
 	if (err)
 		return err;
 
+	sysfs_notify(&data->acpi_dev->dev.kobj, NULL, scai_features[SCAI_FEATURE_PERF_MODE].name);
+
 	return 0;
 }
 
-static int scai_enable(struct scai_data *data)
+static void scai_profile_choices(struct scai_data *data, unsigned long *choices)
 {
-	return scai_command_integer(data, "SDLS", 1, NULL);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(scai_perf_mode_profiles); i++) {
+		if (data->supported_perf_modes & BIT(scai_perf_mode_profiles[i].mode))
+			set_bit(scai_perf_mode_profiles[i].profile, choices);
+	}
 }
 
-static int scai_disable(struct scai_data *data)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0)
+static int scai_profile_probe(void *drvdata, unsigned long *choices)
 {
-	return scai_command_integer(data, "SDLS", 0, NULL);
+	scai_profile_choices(drvdata, choices);
+
+	return 0;
 }
 
-static ssize_t get_battery_life_extender(struct device *dev, struct device_attribute *attr, char *buf)
+static int scai_profile_get(struct device *dev, enum platform_profile_option *profile)
 {
-	struct scai_data *data = dev_get_drvdata(dev);
-	int err;
-	u8 value;
+	return scai_profile_read(dev_get_drvdata(dev), profile);
+}
 
-	err = scai_battery_life_extender_get(data, &value);
-	if (err)
-		return err;
+static int scai_profile_set(struct device *dev, enum platform_profile_option profile)
+{
+	return scai_profile_write(dev_get_drvdata(dev), profile);
+}
+
+static const struct platform_profile_ops scai_profile_ops = {
+	.probe = scai_profile_probe,
+	.profile_get = scai_profile_get,
+	.profile_set = scai_profile_set,
+};
+
+static int scai_profile_add(struct scai_data *data)
+{
+	data->profile_dev = devm_platform_profile_register(&data->acpi_dev->dev, "samsung_acpi", data, &scai_profile_ops);
 
-	return sprintf(buf, "%d\n", value);
+	return PTR_ERR_OR_ZERO(data->profile_dev);
 }
 
-static ssize_t set_battery_life_extender(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+static void scai_profile_notify(struct scai_data *data)
 {
-	struct scai_data *data = dev_get_drvdata(dev);
-	int ret, value;
+	if (data->profile_registered)
+		platform_profile_notify(data->profile_dev);
+}
 
-	if (!count || kstrtoint(buf, 0, &value) != 0)
-		return -EINVAL;
+/* The profile is unregistered by devm */
+static void scai_profile_unregister(struct scai_data *data)
+{
+}
+#else
+static int scai_profile_get(struct platform_profile_handler *pprof, enum platform_profile_option *profile)
+{
+	return scai_profile_read(container_of(pprof, struct scai_data, profile), profile);
+}
 
-	ret = scai_battery_life_extender_set(data, value);
-	if (ret < 0)
-		return ret;
+static int scai_profile_set(struct platform_profile_handler *pprof, enum platform_profile_option profile)
+{
+	return scai_profile_write(container_of(pprof, struct scai_data, profile), profile);
+}
 
-	return count;
+static int scai_profile_add(struct scai_data *data)
+{
+	scai_profile_choices(data, data->profile.choices);
+	data->profile.profile_get = scai_profile_get;
+	data->profile.profile_set = scai_profile_set;
+
+	return platform_profile_register(&data->profile);
+}
+
+static void scai_profile_notify(struct scai_data *data)
+{
+	if (data->profile_registered)
+		platform_profile_notify();
+}
+
+static void scai_profile_unregister(struct scai_data *data)
+{
+	if (data->profile_registered)
+		platform_profile_remove();
+}
+#endif
+
+/*
+ * Exposes the performance modes supported by the firmware as platform
+ * profiles. Before 6.14 only one profile handler can be registered in the
+ * system, so failing here is not fatal: perf_mode is still there.
+ */
+static void scai_profile_register(struct scai_data *data)
+{
+	int err;
+
+	if (!data->supported_perf_modes)
+		return;
+
+	err = scai_profile_add(data);
+	if (err) {
+		pr_warn("scai_profile_register: cannot register platform profile: %d\n", err);
+		return;
+	}
+
+	data->profile_registered = true;
+}
+#else
+static inline void scai_profile_register(struct scai_data *data)
+{
+}
+
+static inline void scai_profile_notify(struct scai_data *data)
+{
 }
 
-static DEVICE_ATTR(battery_life_extender, 0644, get_battery_life_extender, set_battery_life_extender);
+static inline void scai_profile_unregister(struct scai_data *data)
+{
+}
+#endif
 
-static ssize_t get_autoboot(struct device *dev, struct device_attribute *attr, char *buf)
+static ssize_t scai_feature_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
 	struct scai_data *data = dev_get_drvdata(dev);
+	enum scai_feature_id id = attr - data->feature_attrs;
+	const struct scai_value_name *name;
 	int err;
 	u8 value;
 
-	err = scai_autoboot_get(data, &value);
+	err = scai_feature_read(data, id, &value);
 	if (err)
 		return err;
 
-	return sprintf(buf, "%d\n", value);
+	if (!scai_features[id].names)
+		return sprintf(buf, "%d\n", value);
+
+	for (name = scai_features[id].names; name->name; name++) {
+		if (name->value == value)
+			return sprintf(buf, "%s\n", name->name);
+	}
+
+	return -EINVAL;
 }
 
-static ssize_t set_autoboot(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+static ssize_t scai_feature_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
 {
 	struct scai_data *data = dev_get_drvdata(dev);
+	enum scai_feature_id id = attr - data->feature_attrs;
+	const struct scai_feature *feature = &scai_features[id];
+	const struct scai_value_name *name;
 	int ret, value;
 
-	if (!count || kstrtoint(buf, 0, &value) != 0)
+	if (!count)
 		return -EINVAL;
 
-	ret = scai_autoboot_set(data, !!value);
+	if (feature->names) {
+		for (name = feature->names; name->name; name++) {
+			if (sysfs_streq(buf, name->name))
+				break;
+		}
+
+		if (!name->name)
+			return -EINVAL;
+
+		value = name->value;
+	} else {
+		if (kstrtoint(buf, 0, &value) != 0)
+			return -EINVAL;
+
+		if (feature->flags & SCAI_FEATURE_BOOL)
+			value = !!value;
+
+		if (value < 0 || value > feature->max)
+			return -EINVAL;
+	}
+
+	ret = scai_feature_set(data, id, value);
 	if (ret < 0)
 		return ret;
 
+	if (id == SCAI_FEATURE_PERF_MODE)
+		scai_profile_notify(data);
+
 	return count;
 }
 
-static DEVICE_ATTR(autoboot, 0644, get_autoboot, set_autoboot);
+/*
+ * The firmware changed the performance mode on its own (Fn hotkey): only tell
+ * the listeners, they will read the new mode if they care.
+ */
+static void scai_perf_mode_notify(struct scai_data *data)
+{
+	sysfs_notify(&data->acpi_dev->dev.kobj, NULL, scai_features[SCAI_FEATURE_PERF_MODE].name);
 
-static ssize_t get_webcam_enable(struct device *dev, struct device_attribute *attr, char *buf)
+	scai_profile_notify(data);
+}
+
+static int kb_led_set(struct led_classdev *led_cdev, enum led_brightness value)
+{
+	struct scai_data *data;
+
+	data = container_of(led_cdev, struct scai_data, kb_led);
+	return scai_feature_set(data, SCAI_FEATURE_KB_BACKLIGHT, value);
+}
+
+static enum led_brightness kb_led_get(struct led_classdev *led_cdev)
 {
-	struct scai_data *data = dev_get_drvdata(dev);
 	int err;
+	struct scai_data *data;
 	u8 value;
 
-	err = scai_webcam_enable_get(data, &value);
+	data = container_of(led_cdev, struct scai_data, kb_led);
+	err = scai_feature_read(data, SCAI_FEATURE_KB_BACKLIGHT, &value);
 	if (err)
-		return err;
+		return 0;
 
-	return sprintf(buf, "%d\n", value);
+	return value;
 }
 
-static ssize_t set_webcam_enable(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+/*
+ * Lists the features currently answered from the cache because the firmware
+ * is slow, pollable for changes.
+ */
+static ssize_t stale_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
 	struct scai_data *data = dev_get_drvdata(dev);
-	int ret, value;
+	int i, len = 0;
 
-	if (!count || kstrtoint(buf, 0, &value) != 0)
-		return -EINVAL;
+	spin_lock(&data->feature_lock);
 
-	ret = scai_webcam_enable_set(data, value);
-	if (ret < 0)
-		return ret;
+	for (i = 0; i < SCAI_FEATURES; i++) {
+		if (data->feature_state[i].stale)
+			len += sprintf(buf + len, "%s%s", len ? " " : "", scai_features[i].name);
+	}
 
-	return count;
+	spin_unlock(&data->feature_lock);
+
+	len += sprintf(buf + len, "\n");
+
+	return len;
 }
+static DEVICE_ATTR_RO(stale);
 
-static DEVICE_ATTR(webcam_enable, 0644, get_webcam_enable, set_webcam_enable);
+/*
+ * The LED and the sysfs attributes are generated from the feature table.
+ */
+static int scai_register_features(struct scai_data *data)
+{
+	const struct scai_feature *feature;
+	struct device_attribute *attr;
+	int err, i, count = 0;
+
+	for (i = 0; i < SCAI_FEATURES; i++) {
+		feature = &scai_features[i];
+
+		if (feature->flags & SCAI_FEATURE_LED) {
+			data->kb_led.name = feature->name;
+			data->kb_led.brightness_set_blocking = kb_led_set;
+			data->kb_led.brightness_get = kb_led_get;
+			data->kb_led.max_brightness = feature->max;
+
+			err = devm_led_classdev_register(&data->acpi_dev->dev, &data->kb_led);
+			if (err)
+				return err;
+
+			continue;
+		}
+
+		attr = &data->feature_attrs[i];
+		sysfs_attr_init(&attr->attr);
+		attr->attr.name = feature->name;
+		attr->attr.mode = 0644;
+		attr->show = scai_feature_show;
+		attr->store = scai_feature_store;
+
+		data->attrs[count++] = &attr->attr;
+	}
+
+	data->attrs[count++] = &dev_attr_stale.attr;
+
+	data->attribute_group.attrs = data->attrs;
+
+	return sysfs_create_group(&data->acpi_dev->dev.kobj, &data->attribute_group);
+}
 
-static ssize_t get_perf_mode(struct device *dev, struct device_attribute *attr, char *buf)
+/*
+ * All the codes share notify_work, which is armed for the earliest deadline of
+ * the pending ones. It acknowledges with SETM, which may hang like any firmware
+ * call, so it does not run on system_wq. Called with notify_lock held.
+ */
+static void scai_notify_arm(struct scai_data *data, unsigned long deadline, unsigned long now)
 {
-	struct scai_data *data = dev_get_drvdata(dev);
-	int err;
-	enum scai_perf_modes value;
+	if (data->notify_armed && !time_before(deadline, data->notify_deadline))
+		return;
 
-	err = scai_perf_mode_get(data, &value);
-	if (err)
-		return err;
+	data->notify_armed = true;
+	data->notify_deadline = deadline;
+	mod_delayed_work(system_unbound_wq, &data->notify_work, time_after(deadline, now) ? deadline - now : 0);
+}
+
+/*
+ * Rate limiting is done per event code over a fixed window: the first
+ * notify_burst events of a window are acknowledged right away, later ones only
+ * mark the code as pending and are acknowledged once, by the notify work, when
+ * the window closes. A storm then costs a spinlock and a few counters per
+ * event instead of an AML evaluation and a printk.
+ */
+static bool scai_notify_account(struct scai_data *data, u32 event)
+{
+	struct scai_notify_stats *stats = &data->notify_stats[event];
+	unsigned long interval = msecs_to_jiffies(notify_interval_ms);
+	unsigned long now = jiffies;
+	bool limited = false;
+
+	spin_lock(&data->notify_lock);
+
+	if (!stats->window_count || time_after_eq(now, stats->window_start + interval)) {
+		/* Nothing happened in the previous window if this one started later */
+		stats->rate = time_before(now, stats->window_start + 2 * interval) ? stats->window_count : 0;
+		stats->window_start = now;
+		stats->window_count = 0;
+	}
+
+	stats->window_count++;
+	stats->count++;
+	stats->last_ns = ktime_get_ns();
+
+	if (notify_burst && stats->window_count > notify_burst) {
+		stats->coalesced++;
+		limited = true;
+
+		if (!stats->pending) {
+			stats->pending = true;
+			stats->deadline = stats->window_start + interval;
+			scai_notify_arm(data, stats->deadline, now);
+		}
+	}
+
+	spin_unlock(&data->notify_lock);
 
-	switch (value) {
-		case SCAI_PERF_OPTIMIZED:
-			return sprintf(buf, SCAI_PERF_OPTIMIZED_STR "\n");
+	return limited;
+}
+
+static void scai_notify_handle(struct scai_data *data, u32 event)
+{
+	scai_command_integer(data, SCAI_TRACE_SETM, event, NULL);
+
+	/*
+	 * Which code follows an autoboot change is not known, so the unknown
+	 * codes trigger a sample of everything. Storms are already coalesced
+	 * above and a sample that is still queued is not queued again.
+	 */
+	switch (event) {
+		case SCAI_NOTIFY_PERF_MODE:
+			scai_perf_mode_notify(data);
 			break;
-		case SCAI_PERF_PERFORMANCE:
-			return sprintf(buf, SCAI_PERF_PERFORMANCE_STR "\n");
+		case SCAI_NOTIFY_ON_TABLE:
+		case SCAI_NOTIFY_OFF_TABLE:
 			break;
-		case SCAI_PERF_QUIET:
-			return sprintf(buf, SCAI_PERF_QUIET_STR "\n");
+		case SCAI_NOTIFY_BATTERY_STATE:
+			scai_sample_queue(data, BIT(SCAI_FEATURE_BATTERY_LIFE_EXTENDER));
 			break;
-		case SCAI_PERF_SILENT:
-			return sprintf(buf, SCAI_PERF_SILENT_STR "\n");
+		default:
+			scai_sample_queue(data, ~0UL);
 			break;
 	}
+}
 
-	return -EINVAL;
+static void scai_notify_work(struct work_struct *work)
+{
+	struct scai_data *data = container_of(to_delayed_work(work), struct scai_data, notify_work);
+	struct scai_notify_stats *stats;
+	unsigned long now = jiffies;
+	u32 event;
+	bool due;
+
+	spin_lock(&data->notify_lock);
+	data->notify_armed = false;
+	spin_unlock(&data->notify_lock);
+
+	for (event = 0; event < SCAI_NOTIFY_CODES; event++) {
+		stats = &data->notify_stats[event];
+
+		spin_lock(&data->notify_lock);
+		due = stats->pending && time_after_eq(now, stats->deadline);
+		if (due)
+			stats->pending = false;
+		else if (stats->pending)
+			scai_notify_arm(data, stats->deadline, now);
+		spin_unlock(&data->notify_lock);
+
+		if (due)
+			scai_notify_handle(data, event);
+	}
 }
 
-static ssize_t set_perf_mode(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+static int scai_notify_stats_show(struct seq_file *m, void *v)
 {
-	struct scai_data *data = dev_get_drvdata(dev);
-	int err;
-	enum scai_perf_modes value;
+	struct scai_data *data = m->private;
+	struct scai_notify_stats stats;
+	unsigned long interval = msecs_to_jiffies(notify_interval_ms);
+	u32 event;
+
+	seq_printf(m, "burst %u interval_ms %u invalid %llu\n",
+		notify_burst, notify_interval_ms, data->notify_invalid);
+	seq_puts(m, "code count coalesced rate last_ns\n");
+
+	for (event = 0; event < SCAI_NOTIFY_CODES; event++) {
+		spin_lock(&data->notify_lock);
+		stats = data->notify_stats[event];
+		spin_unlock(&data->notify_lock);
+
+		if (!stats.count)
+			continue;
+
+		/* rate is only updated by the next event, which may never come */
+		if (time_after_eq(jiffies, stats.window_start + 2 * interval))
+			stats.rate = 0;
+		else if (time_after_eq(jiffies, stats.window_start + interval))
+			stats.rate = stats.window_count;
+
+		seq_printf(m, "0x%02x %llu %llu %u %llu\n",
+			event, stats.count, stats.coalesced, stats.rate, stats.last_ns);
+	}
 
-	if (!count)
-		return -EINVAL;
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(scai_notify_stats);
 
-	if (strncmp(buf, SCAI_PERF_OPTIMIZED_STR, strlen(SCAI_PERF_OPTIMIZED_STR)) == 0)
-		value = SCAI_PERF_OPTIMIZED;
-	else if (strncmp(buf, SCAI_PERF_PERFORMANCE_STR, strlen(SCAI_PERF_PERFORMANCE_STR)) == 0)
-		value = SCAI_PERF_PERFORMANCE;
-	else if (strncmp(buf, SCAI_PERF_QUIET_STR, strlen(SCAI_PERF_QUIET_STR)) == 0)
-		value = SCAI_PERF_QUIET;
-	else if (strncmp(buf, SCAI_PERF_SILENT_STR, strlen(SCAI_PERF_SILENT_STR)) == 0)
-		value = SCAI_PERF_SILENT;
-	else
-		return -EINVAL;
+static int scai_watchdog_show(struct seq_file *m, void *v)
+{
+	struct scai_data *data = m->private;
+	struct scai_feature_state *state;
+	int i;
 
-	err = scai_perf_mode_set(data, value);
-	if (err < 0)
-		return err;
+	seq_printf(m, "slow_limit %u slow_backoff_ms %u\n", slow_limit, slow_backoff_ms);
+	seq_puts(m, "feature budget_ms last_ns slow stale_reads backoffs stale backoff\n");
 
-	return count;
+	spin_lock(&data->feature_lock);
+
+	for (i = 0; i < SCAI_FEATURES; i++) {
+		state = &data->feature_state[i];
+
+		seq_printf(m, "%s %u %llu %lu %lu %lu %d %d\n",
+			scai_features[i].name, scai_features[i].budget_ms, state->last_ns,
+			state->slow, state->stale_reads, state->backoffs, state->stale,
+			state->backoff_until && time_before(jiffies, state->backoff_until));
+	}
+
+	spin_unlock(&data->feature_lock);
+
+	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(scai_watchdog);
+
+#ifdef SCAI_RECORDER
+/*
+ * The file offset maps to a sequence number, so consecutive reads stream the
+ * records in order. Reads that fell behind the ring buffer skip ahead to the
+ * oldest record still available.
+ */
+static ssize_t scai_trace_read(struct file *file, char __user *ubuf, size_t count, loff_t *ppos)
+{
+	struct scai_data *data = file->private_data;
+	struct scai_trace_record *rec;
+	size_t copied = 0, chunk;
+	u64 seq, oldest;
+	u32 offset, slot;
+	ssize_t err = 0;
+
+	rec = kmalloc(sizeof(*rec), GFP_KERNEL);
+	if (!rec)
+		return -ENOMEM;
 
-static DEVICE_ATTR(perf_mode, 0644, get_perf_mode, set_perf_mode);
+	while (copied < count) {
+		seq = div_u64_rem(*ppos, sizeof(*rec), &offset);
 
-static struct attribute *scai_attributes[] = {
-	&dev_attr_battery_life_extender.attr,
-	&dev_attr_autoboot.attr,
-	&dev_attr_webcam_enable.attr,
-	&dev_attr_perf_mode.attr,
-	NULL
-};
+		spin_lock(&data->trace_lock);
+
+		oldest = data->trace_seq > data->trace_len ? data->trace_seq - data->trace_len : 0;
+		if (seq < oldest) {
+			seq = oldest;
+			offset = 0;
+		}
+
+		if (seq >= data->trace_seq) {
+			spin_unlock(&data->trace_lock);
+			break;
+		}
+
+		div_u64_rem(seq, data->trace_len, &slot);
+		memcpy(rec, &data->trace[slot], sizeof(*rec));
+
+		spin_unlock(&data->trace_lock);
+
+		chunk = min_t(size_t, sizeof(*rec) - offset, count - copied);
+		if (copy_to_user(ubuf + copied, (u8 *) rec + offset, chunk)) {
+			err = -EFAULT;
+			break;
+		}
+
+		copied += chunk;
+		*ppos = seq * sizeof(*rec) + offset + chunk;
+	}
+
+	kfree(rec);
 
-static const struct attribute_group scai_attribute_group = {
-	.attrs = scai_attributes
+	return copied ? copied : err;
+}
+
+static const struct file_operations scai_trace_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = scai_trace_read,
+	.llseek = default_llseek,
 };
 
-static int kb_led_set(struct led_classdev *led_cdev, enum led_brightness value)
+/*
+ * The recorder is only a diagnostic, the driver works without it when the ring
+ * buffer cannot be allocated.
+ */
+static void scai_trace_init(struct scai_data *data)
 {
-	struct scai_data *data;
+	spin_lock_init(&data->trace_lock);
 
-	data = container_of(led_cdev, struct scai_data, kb_led);
-	return scai_kb_backlight_set(data, value);
+	if (!trace_records)
+		return;
+
+	data->trace = devm_kcalloc(&data->acpi_dev->dev, trace_records, sizeof(*data->trace), GFP_KERNEL | __GFP_NOWARN);
+	if (!data->trace) {
+		pr_warn("scai_trace_init: cannot allocate %u trace records, recorder disabled\n", trace_records);
+		return;
+	}
+
+	data->trace_len = trace_records;
 }
 
-static enum led_brightness kb_led_get(struct led_classdev *led_cdev)
+static void scai_trace_debugfs_init(struct scai_data *data)
 {
-	int err;
-	struct scai_data *data;
-	u8 value;
+	if (data->trace)
+		debugfs_create_file("trace", 0400, data->debugfs, data, &scai_trace_fops);
+}
+#else
+static inline void scai_trace_init(struct scai_data *data)
+{
+}
 
-	data = container_of(led_cdev, struct scai_data, kb_led);
-	err = scai_kb_backlight_get(data, &value);
-	if (err)
-		return 0;
+static inline void scai_trace_debugfs_init(struct scai_data *data)
+{
+}
+#endif
 
-	return value;
+static void scai_debugfs_init(struct scai_data *data)
+{
+	data->debugfs = debugfs_create_dir("samsung_acpi", NULL);
+	debugfs_create_file("notify_stats", 0444, data->debugfs, data, &scai_notify_stats_fops);
+	debugfs_create_file("watchdog", 0444, data->debugfs, data, &scai_watchdog_fops);
+	scai_trace_debugfs_init(data);
+}
+
+static void scai_debugfs_exit(struct scai_data *data)
+{
+	debugfs_remove_recursive(data->debugfs);
 }
 
 static int scai_add(struct acpi_device *acpi_dev)
@@ -719,31 +1746,45 @@ static int scai_add(struct acpi_device *acpi_dev)
 	dev_set_drvdata(&acpi_dev->dev, data);
 	data->acpi_dev = acpi_dev;
 
-	err = scai_enable(data);
+	spin_lock_init(&data->notify_lock);
+	INIT_DELAYED_WORK(&data->notify_work, scai_notify_work);
+	mutex_init(&data->sample_lock);
+	INIT_WORK(&data->sample_work, scai_sample_work);
+
+	scai_feature_state_init(data);
+
+	err = devm_add_action_or_reset(&acpi_dev->dev, scai_feature_state_release, data);
 	if (err)
 		return err;
 
-	err = scai_init(data);
+	scai_trace_init(data);
+
+	err = scai_resolve_methods(data);
 	if (err)
 		return err;
 
-	err = scai_notification_set(data);
+	err = scai_enable(data);
 	if (err)
 		return err;
 
-	data->kb_led.name = "scai::kbd_backlight";
-	data->kb_led.brightness_set_blocking = kb_led_set;
-	data->kb_led.brightness_get = kb_led_get;
-	data->kb_led.max_brightness = 3;
+	err = scai_init(data);
+	if (err)
+		return err;
 
-	err = devm_led_classdev_register(&acpi_dev->dev, &data->kb_led);
+	err = scai_notification_set(data);
 	if (err)
 		return err;
 
-	err = sysfs_create_group(&acpi_dev->dev.kobj, &scai_attribute_group);
+	err = scai_register_features(data);
 	if (err)
 		return err;
 
+	scai_profile_register(data);
+
+	scai_debugfs_init(data);
+
+	scai_sample_queue(data, ~0UL);
+
 	return 0;
 }
 
@@ -754,10 +1795,19 @@ static void scai_remove(struct acpi_device *acpi_dev)
 
 	data = dev_get_drvdata(&acpi_dev->dev);
 
-	sysfs_remove_group(&acpi_dev->dev.kobj, &scai_attribute_group);
+	scai_debugfs_exit(data);
+
+	scai_profile_unregister(data);
+
+	sysfs_remove_group(&acpi_dev->dev.kobj, &data->attribute_group);
+
+	cancel_delayed_work_sync(&data->notify_work);
+	cancel_work_sync(&data->sample_work);
 
 	devm_led_classdev_unregister(&acpi_dev->dev, &data->kb_led);
 
+	scai_feature_state_exit(data);
+
 	err = scai_disable(data);
 }
 
@@ -767,11 +1817,37 @@ static void scai_notify(struct acpi_device *acpi_dev, u32 event)
 
 	data = dev_get_drvdata(&acpi_dev->dev);
 
-	scai_command_integer(data, "SETM", event, NULL);
+	if (event >= SCAI_NOTIFY_CODES) {
+		data->notify_invalid++;
+		pr_warn_ratelimited("Invalid notify %x", event);
+		return;
+	}
+
+	if (scai_notify_account(data, event))
+		return;
 
+	scai_notify_handle(data, event);
+
+#ifdef SCAI_DEBUG
 	pr_info("Notify %x", event);
+#endif
 }
 
+/*
+ * The settings may have been changed from the BIOS setup or another OS while
+ * suspended or hibernated.
+ */
+static int scai_resume(struct device *dev)
+{
+	struct scai_data *data = dev_get_drvdata(dev);
+
+	scai_sample_queue(data, ~0UL);
+
+	return 0;
+}
+
+static DEFINE_SIMPLE_DEV_PM_OPS(scai_pm, NULL, scai_resume);
+
 static struct acpi_driver scai_driver = {
 	.name = "samsung_acpi",
 	.ids = device_ids,
@@ -781,6 +1857,7 @@ static struct acpi_driver scai_driver = {
 		.remove = scai_remove,
 		.notify = scai_notify
 	},
+	.drv.pm = pm_sleep_ptr(&scai_pm),
 };
 module_acpi_driver(scai_driver);
 
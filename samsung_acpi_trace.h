@@ -0,0 +1,43 @@
+#ifndef SAMSUNG_ACPI_TRACE_H
+#define SAMSUNG_ACPI_TRACE_H
+
+#include <linux/types.h>
+
+/*
+ * Layout of the SCAI traffic trace, shared by the driver (which exports it in
+ * debugfs as samsung_acpi/trace) and the userspace replayer.
+ *
+ * The trace is a plain sequence of fixed size records, oldest first. Records
+ * that were overwritten in the ring buffer before being read are skipped, which
+ * shows up as a gap in seq.
+ */
+
+#define SCAI_TRACE_DATA_LEN 0x100
+
+enum scai_trace_method {
+	SCAI_TRACE_CSFI = 0,
+	SCAI_TRACE_CSXI = 1,
+	SCAI_TRACE_SDLS = 2,
+	SCAI_TRACE_SETM = 3,
+};
+
+enum scai_trace_status {
+	SCAI_TRACE_OK = 0,
+	SCAI_TRACE_FAILED = 1,
+};
+
+struct scai_trace_record {
+	__u64 seq;
+	__u64 timestamp_ns;
+	__u32 latency_ns;
+	__u8 method;
+	__u8 status;
+	__u16 len;
+	/* Argument of the integer methods (SDLS, SETM) */
+	__u64 arg;
+	/* Buffers of the complex methods (CSFI, CSXI), len bytes are valid */
+	__u8 request[SCAI_TRACE_DATA_LEN];
+	__u8 response[SCAI_TRACE_DATA_LEN];
+};
+
+#endif
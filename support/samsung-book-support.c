@@ -1,11 +1,17 @@
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <linux/input.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <gudev/gudev.h>
 
 #define UPOWER_DBUS_NAME						"org.freedesktop.UPower"
 #define UPOWER_DBUS_PATH						"/org/freedesktop/UPower"
@@ -13,23 +19,148 @@
 #define UPOWER_DBUS_INTERFACE					"org.freedesktop.UPower"
 #define UPOWER_DBUS_INTERFACE_KBDBACKLIGHT		"org.freedesktop.UPower.KbdBacklight"
 
-#define SAMSUNG_BOOK_KEYBOARD_INPUT				"/dev/input/event2"
+#define SAMSUNG_BOOK_KEYBOARD_SCANCODE			0xac
+
+#define BITS_PER_LONG							(sizeof(long) * 8)
+
+#define METRICS_SOCKET_ENV						"SAMSUNG_BOOK_METRICS_SOCKET"
+#define METRICS_SOCKET_NAME						"samsung-book-support.sock"
+
+// Upper bounds of the latency histogram buckets, in microseconds
+static const gint64 metrics_buckets[] = {
+	250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000
+};
+
+#define METRICS_BUCKETS							G_N_ELEMENTS(metrics_buckets)
+
+struct histogram {
+	guint64 buckets[METRICS_BUCKETS + 1];
+	guint64 count;
+	guint64 sum_us;
+};
+
+enum metrics_call {
+	METRICS_CALL_GET_MAX_BRIGHTNESS,
+	METRICS_CALL_GET_BRIGHTNESS,
+	METRICS_CALL_SET_BRIGHTNESS,
+	METRICS_CALLS
+};
+
+enum metrics_error {
+	METRICS_ERROR_SHORT_READ,
+	METRICS_ERROR_OPEN_KEYBOARD,
+	METRICS_ERROR_CONNECT,
+	METRICS_ERROR_GET_MAX_BRIGHTNESS,
+	METRICS_ERROR_GET_BRIGHTNESS,
+	METRICS_ERROR_SET_BRIGHTNESS,
+	METRICS_ERROR_METRICS_LISTEN,
+	METRICS_ERROR_METRICS_WRITE,
+	METRICS_ERRORS
+};
+
+static const gchar *metrics_call_names[METRICS_CALLS] = {
+	[METRICS_CALL_GET_MAX_BRIGHTNESS] = "GetMaxBrightness",
+	[METRICS_CALL_GET_BRIGHTNESS] = "GetBrightness",
+	[METRICS_CALL_SET_BRIGHTNESS] = "SetBrightness",
+};
+
+static const gchar *metrics_error_names[METRICS_ERRORS] = {
+	[METRICS_ERROR_SHORT_READ] = "short_read",
+	[METRICS_ERROR_OPEN_KEYBOARD] = "open_keyboard",
+	[METRICS_ERROR_CONNECT] = "connect",
+	[METRICS_ERROR_GET_MAX_BRIGHTNESS] = "get_max_brightness",
+	[METRICS_ERROR_GET_BRIGHTNESS] = "get_brightness",
+	[METRICS_ERROR_SET_BRIGHTNESS] = "set_brightness",
+	[METRICS_ERROR_METRICS_LISTEN] = "metrics_listen",
+	[METRICS_ERROR_METRICS_WRITE] = "metrics_write",
+};
+
+/*
+ * Everything runs in the main loop, so the counters are plain integers: the
+ * event path only increments them, formatting is done when the socket is read.
+ */
+struct metrics {
+	guint64 events_read;
+	guint64 events_filtered;
+	guint64 presses;
+	guint64 presses_debounced;
+	guint64 presses_coalesced;
+	guint64 calls[METRICS_CALLS];
+	struct histogram call_latency[METRICS_CALLS];
+	struct histogram key_to_light;
+	guint64 errors[METRICS_ERRORS];
+};
+
+struct keyboard {
+	gchar *devnode;
+	GIOChannel *channel;
+	guint watch;
+	struct input_event pv;
+};
 
 GDBusProxy *upowerd;
 GApplication *app;
+GUdevClient *udev;
+GHashTable *keyboards;
 int brightness_max;
 
+// At most one brightness update is in flight, presses queue up in between
+gboolean brightness_ready;
+gboolean brightness_in_flight;
+int brightness_presses;
+
+// Time of the first press of the batch that is pending or in flight
+gint64 brightness_first_press;
+gint64 brightness_batch_press;
+gint64 brightness_call_start;
+
+struct metrics metrics;
+GSocketService *metrics_service;
+gchar *metrics_socket;
+
+static void brightness_update();
+
+static void histogram_observe(struct histogram *h, gint64 us)
+{
+	guint i;
+
+	for (i = 0; i < METRICS_BUCKETS && us > metrics_buckets[i]; i++)
+		;
+
+	h->buckets[i]++;
+	h->count++;
+	h->sum_us += us;
+}
+
+static void metrics_call_start()
+{
+	brightness_call_start = g_get_monotonic_time();
+}
+
+static void metrics_call_end(enum metrics_call call)
+{
+	metrics.calls[call]++;
+	histogram_observe(&metrics.call_latency[call], g_get_monotonic_time() - brightness_call_start);
+}
+
 static gboolean libevdev_event_handler(GIOChannel *source, GIOCondition condition, gpointer data)
 {
-	static struct input_event pv = {0};
+	struct keyboard *kbd = data;
 	struct input_event ev;
 	struct timeval td;
 	gsize bytes_read;
 
+	if (condition & (G_IO_HUP | G_IO_ERR)) {
+		// The node went away, the udev remove event will follow
+		kbd->watch = 0;
+		return FALSE;
+	}
+
 	g_io_channel_read_chars(source, (gchar *)&ev, sizeof(ev), &bytes_read, NULL);
 
 	if (bytes_read > 0) {
 		if (bytes_read != sizeof(ev)) {
+			metrics.errors[METRICS_ERROR_SHORT_READ]++;
 			g_warning("warning, only read %ld bytes from keyboard input", bytes_read);
 			return TRUE;
 		}
@@ -37,109 +168,450 @@ static gboolean libevdev_event_handler(GIOChannel *source, GIOCondition conditio
 		return TRUE;
 	}
 
-	if (ev.type == EV_MSC && ev.value == 0xac) {
-		timersub(&ev.time, &pv.time, &td);
-		memcpy(&pv, &ev, sizeof(struct input_event));
+	metrics.events_read++;
 
-		GVariant *k_now = NULL;
-		GVariant *k_set = NULL;
-		GError *error = NULL;
-		int brightness;
+	if (ev.type == EV_MSC && ev.value == SAMSUNG_BOOK_KEYBOARD_SCANCODE) {
+		timersub(&ev.time, &kbd->pv.time, &td);
+		memcpy(&kbd->pv, &ev, sizeof(struct input_event));
 
 		// Debouncing
 		if (td.tv_sec >= 0 && td.tv_usec >= 300000 || td.tv_sec > 0) {
-			k_now = g_dbus_proxy_call_sync (upowerd,
-											"GetBrightness",
-											NULL,
-											G_DBUS_CALL_FLAGS_NONE,
-											-1,
-											NULL,
-											&error);
-			if (k_now == NULL) {
-				g_warning ("Failed to get brightness: %s", error->message);
-				g_error_free (error);
-				goto out;
-			}
-
-			g_variant_get (k_now, "(i)", &brightness);
-
-			int next_brightness = (brightness + 1) % (brightness_max + 1);
-
-			k_set = g_dbus_proxy_call_sync (upowerd,
-											"SetBrightness",
-											g_variant_new("(i)", next_brightness),
-											G_DBUS_CALL_FLAGS_NONE,
-											-1,
-											NULL,
-											&error);
-			if (k_set == NULL) {
-				g_warning ("Failed to get brightness: %s", error->message);
-				g_error_free (error);
-				goto out;
-			}
-		}
+			metrics.presses++;
 
-	out:
-		if (k_now != NULL)
-			g_variant_unref (k_now);
-		if (k_set != NULL)
-			g_variant_unref (k_set);
+			if (brightness_presses == 0)
+				brightness_first_press = g_get_monotonic_time();
+			else
+				metrics.presses_coalesced++;
+
+			brightness_presses++;
+			brightness_update();
+		} else {
+			metrics.presses_debounced++;
+		}
+	} else {
+		metrics.events_filtered++;
 	}
 
 	return TRUE;
 }
 
+static void brightness_set_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	GVariant *k_set;
+	GError *error = NULL;
+
+	k_set = g_dbus_proxy_call_finish (G_DBUS_PROXY(source_object), res, &error);
+	metrics_call_end(METRICS_CALL_SET_BRIGHTNESS);
+	if (k_set == NULL) {
+		metrics.errors[METRICS_ERROR_SET_BRIGHTNESS]++;
+		g_warning ("Failed to set brightness: %s", error->message);
+		g_error_free (error);
+	} else {
+		histogram_observe(&metrics.key_to_light, g_get_monotonic_time() - brightness_batch_press);
+		g_variant_unref (k_set);
+	}
+
+	brightness_in_flight = FALSE;
+
+	// Presses that arrived meanwhile
+	brightness_update();
+}
+
+static void brightness_get_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	GVariant *k_now;
+	GError *error = NULL;
+	int brightness, next_brightness;
+
+	k_now = g_dbus_proxy_call_finish (G_DBUS_PROXY(source_object), res, &error);
+	metrics_call_end(METRICS_CALL_GET_BRIGHTNESS);
+	if (k_now == NULL) {
+		metrics.errors[METRICS_ERROR_GET_BRIGHTNESS]++;
+		g_warning ("Failed to get brightness: %s", error->message);
+		g_error_free (error);
+
+		// Don't retry the same presses forever
+		brightness_presses = 0;
+		brightness_in_flight = FALSE;
+		return;
+	}
+
+	g_variant_get (k_now, "(i)", &brightness);
+	g_variant_unref (k_now);
+
+	// Everything pressed up to now collapses into a single step
+	next_brightness = (brightness + brightness_presses) % (brightness_max + 1);
+	brightness_presses = 0;
+	brightness_batch_press = brightness_first_press;
+
+	metrics_call_start();
+	g_dbus_proxy_call (upowerd,
+						"SetBrightness",
+						g_variant_new("(i)", next_brightness),
+						G_DBUS_CALL_FLAGS_NONE,
+						-1,
+						NULL,
+						brightness_set_cb,
+						NULL);
+}
+
+/*
+ * Starts a Get/Set round trip for the pending presses, unless one is already
+ * in flight or UPower is not ready yet: in both cases the presses are kept and
+ * picked up as soon as the current call completes.
+ */
+static void brightness_update()
+{
+	if (!brightness_ready || brightness_in_flight || brightness_presses == 0)
+		return;
+
+	brightness_in_flight = TRUE;
+
+	metrics_call_start();
+	g_dbus_proxy_call (upowerd,
+						"GetBrightness",
+						NULL,
+						G_DBUS_CALL_FLAGS_NONE,
+						-1,
+						NULL,
+						brightness_get_cb,
+						NULL);
+}
+
+static void power_keyboard_max_brightness_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	GVariant *k_max;
+	GError *error = NULL;
+
+	k_max = g_dbus_proxy_call_finish (G_DBUS_PROXY(source_object), res, &error);
+	metrics_call_end(METRICS_CALL_GET_MAX_BRIGHTNESS);
+	if (k_max == NULL) {
+		metrics.errors[METRICS_ERROR_GET_MAX_BRIGHTNESS]++;
+		g_warning ("Failed to get max brightness: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	g_variant_get (k_max, "(i)", &brightness_max);
+	g_variant_unref (k_max);
+
+	brightness_ready = TRUE;
+
+	// Presses that arrived before UPower was ready
+	brightness_update();
+}
+
 void power_keyboard_proxy_ready_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
-	GVariant *k_max = NULL;
 	GError *error = NULL;
 
 	upowerd = g_dbus_proxy_new_for_bus_finish (res, &error);
 	if (upowerd == NULL) {
+		metrics.errors[METRICS_ERROR_CONNECT]++;
 		g_warning ("Could not connect to UPower: %s",
 					error->message);
 		g_error_free (error);
-		goto out;
+		return;
 	}
 
-	k_max = g_dbus_proxy_call_sync (upowerd,
-									"GetMaxBrightness",
-									NULL,
-									G_DBUS_CALL_FLAGS_NONE,
-									-1,
-									NULL,
-									&error);
-	if (k_max == NULL) {
-		g_warning ("Failed to get max brightness: %s", error->message);
+	metrics_call_start();
+	g_dbus_proxy_call (upowerd,
+						"GetMaxBrightness",
+						NULL,
+						G_DBUS_CALL_FLAGS_NONE,
+						-1,
+						NULL,
+						power_keyboard_max_brightness_cb,
+						NULL);
+}
+
+/*
+ * Tests a bit of one of the capability bitmaps exported by the input device in
+ * sysfs. The bitmap is a list of hex longs, most significant word first.
+ */
+static gboolean keyboard_test_capability(GUdevDevice *input, const gchar *attr, guint bit)
+{
+	const gchar *bitmap;
+	gchar **words;
+	guint nwords, word;
+	unsigned long value = 0;
+
+	bitmap = g_udev_device_get_sysfs_attr(input, attr);
+	if (bitmap == NULL)
+		return FALSE;
+
+	words = g_strsplit(bitmap, " ", -1);
+	nwords = g_strv_length(words);
+	word = bit / BITS_PER_LONG;
+
+	if (word < nwords)
+		value = strtoul(words[nwords - 1 - word], NULL, 16);
+
+	g_strfreev(words);
+
+	return (value >> (bit % BITS_PER_LONG)) & 1;
+}
+
+/*
+ * Only the udev database and the sysfs capabilities are looked at here, the
+ * device node is not opened unless the device matches.
+ */
+static gboolean keyboard_match(GUdevDevice *device)
+{
+	GUdevDevice *input;
+	const gchar *name;
+	gboolean match;
+
+	name = g_udev_device_get_name(device);
+	if (name == NULL || !g_str_has_prefix(name, "event"))
+		return FALSE;
+
+	if (g_udev_device_get_device_file(device) == NULL)
+		return FALSE;
+
+	if (!g_udev_device_get_property_as_boolean(device, "ID_INPUT_KEYBOARD"))
+		return FALSE;
+
+	input = g_udev_device_get_parent(device);
+	if (input == NULL)
+		return FALSE;
+
+	match = keyboard_test_capability(input, "capabilities/ev", EV_MSC) &&
+			keyboard_test_capability(input, "capabilities/msc", MSC_SCAN);
+
+	g_object_unref(input);
+
+	return match;
+}
+
+static void keyboard_free(gpointer data)
+{
+	struct keyboard *kbd = data;
+
+	if (kbd->watch)
+		g_source_remove(kbd->watch);
+	if (kbd->channel != NULL)
+		g_io_channel_unref(kbd->channel);
+
+	g_free(kbd->devnode);
+	g_free(kbd);
+}
+
+static void keyboard_add(GUdevDevice *device)
+{
+	struct keyboard *kbd;
+	const gchar *devnode;
+	GError *error = NULL;
+
+	devnode = g_udev_device_get_device_file(device);
+	if (g_hash_table_contains(keyboards, devnode))
+		return;
+
+	kbd = g_new0(struct keyboard, 1);
+	kbd->devnode = g_strdup(devnode);
+
+	kbd->channel = g_io_channel_new_file(kbd->devnode, "r", &error);
+	if (kbd->channel == NULL) {
+		metrics.errors[METRICS_ERROR_OPEN_KEYBOARD]++;
+		g_warning ("Failed to open keyboard input %s: %s", kbd->devnode, error->message);
 		g_error_free (error);
-		goto out;
+		goto err;
 	}
 
-	g_variant_get (k_max, "(i)", &brightness_max);
+	if (g_io_channel_set_encoding(kbd->channel, NULL, &error) != G_IO_STATUS_NORMAL) {
+		metrics.errors[METRICS_ERROR_OPEN_KEYBOARD]++;
+		g_warning ("Failed to open keyboard input %s: %s", kbd->devnode, error->message);
+		g_error_free (error);
+		goto err;
+	}
 
-out:
-	if (k_max != NULL)
-		g_variant_unref (k_max);
+	kbd->watch = g_io_add_watch(kbd->channel, G_IO_IN | G_IO_HUP | G_IO_ERR, libevdev_event_handler, kbd);
+
+	g_hash_table_insert(keyboards, kbd->devnode, kbd);
+	g_message ("Watching keyboard input %s", kbd->devnode);
+
+	return;
+
+err:
+	keyboard_free(kbd);
 }
 
-void application_activate_handler()
+static void keyboard_remove(GUdevDevice *device)
 {
+	const gchar *devnode;
+
+	devnode = g_udev_device_get_device_file(device);
+	if (devnode == NULL)
+		return;
+
+	if (g_hash_table_remove(keyboards, devnode))
+		g_message ("Keyboard input %s removed", devnode);
+}
+
+static void udev_uevent_handler(GUdevClient *client, const gchar *action, GUdevDevice *device, gpointer user_data)
+{
+	if (g_strcmp0(action, "add") == 0) {
+		if (keyboard_match(device))
+			keyboard_add(device);
+	} else if (g_strcmp0(action, "remove") == 0) {
+		keyboard_remove(device);
+	}
+}
+
+static void metrics_append_histogram(GString *out, const gchar *name, const gchar *labels, struct histogram *h)
+{
+	guint64 cumulative = 0;
+	guint i;
+
+	for (i = 0; i < METRICS_BUCKETS; i++) {
+		cumulative += h->buckets[i];
+		g_string_append_printf(out, "%s_bucket{%sle=\"%" G_GINT64_FORMAT "\"} %" G_GUINT64_FORMAT "\n",
+								name, labels, metrics_buckets[i], cumulative);
+	}
+
+	g_string_append_printf(out, "%s_bucket{%sle=\"+Inf\"} %" G_GUINT64_FORMAT "\n", name, labels, h->count);
+	g_string_append_printf(out, "%s_sum{%s} %" G_GUINT64_FORMAT "\n", name, labels, h->sum_us);
+	g_string_append_printf(out, "%s_count{%s} %" G_GUINT64_FORMAT "\n", name, labels, h->count);
+}
+
+/*
+ * Renders the metrics in the Prometheus text format, latencies are in
+ * microseconds.
+ */
+static gchar *metrics_format()
+{
+	GString *out = g_string_new(NULL);
+	gchar *labels;
+	guint i;
+
+	g_string_append_printf(out, "samsung_book_events_read_total %" G_GUINT64_FORMAT "\n", metrics.events_read);
+	g_string_append_printf(out, "samsung_book_events_filtered_total %" G_GUINT64_FORMAT "\n", metrics.events_filtered);
+	g_string_append_printf(out, "samsung_book_presses_total %" G_GUINT64_FORMAT "\n", metrics.presses);
+	g_string_append_printf(out, "samsung_book_presses_debounced_total %" G_GUINT64_FORMAT "\n", metrics.presses_debounced);
+	g_string_append_printf(out, "samsung_book_presses_coalesced_total %" G_GUINT64_FORMAT "\n", metrics.presses_coalesced);
+	g_string_append_printf(out, "samsung_book_keyboards %u\n", keyboards ? g_hash_table_size(keyboards) : 0);
+
+	for (i = 0; i < METRICS_CALLS; i++)
+		g_string_append_printf(out, "samsung_book_dbus_calls_total{method=\"%s\"} %" G_GUINT64_FORMAT "\n",
+								metrics_call_names[i], metrics.calls[i]);
+
+	for (i = 0; i < METRICS_CALLS; i++) {
+		labels = g_strdup_printf("method=\"%s\",", metrics_call_names[i]);
+		metrics_append_histogram(out, "samsung_book_dbus_call_latency_us", labels, &metrics.call_latency[i]);
+		g_free(labels);
+	}
+
+	metrics_append_histogram(out, "samsung_book_key_to_light_latency_us", "", &metrics.key_to_light);
+
+	for (i = 0; i < METRICS_ERRORS; i++)
+		g_string_append_printf(out, "samsung_book_errors_total{path=\"%s\"} %" G_GUINT64_FORMAT "\n",
+								metrics_error_names[i], metrics.errors[i]);
+
+	return g_string_free(out, FALSE);
+}
+
+static gboolean metrics_incoming_handler(GSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data)
+{
+	GOutputStream *stream;
 	GError *error = NULL;
+	gchar *text;
+
+	text = metrics_format();
+	stream = g_io_stream_get_output_stream(G_IO_STREAM(connection));
 
-	GIOChannel *channel = g_io_channel_new_file(SAMSUNG_BOOK_KEYBOARD_INPUT, "r", &error);
-	if (channel == NULL) {
-		g_warning ("Failed to open keyboard input: %s", error->message);
+	if (!g_output_stream_write_all(stream, text, strlen(text), NULL, NULL, &error)) {
+		metrics.errors[METRICS_ERROR_METRICS_WRITE]++;
+		g_warning ("Failed to write metrics: %s", error->message);
 		g_error_free (error);
-		goto out;
 	}
 
-	if (g_io_channel_set_encoding(channel, NULL, &error) != G_IO_STATUS_NORMAL) {
-		g_warning ("Failed to open keyboard input: %s", error->message);
+	g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+	g_free(text);
+
+	return TRUE;
+}
+
+/*
+ * Every connection to the socket gets a snapshot of the metrics and is then
+ * closed, e.g. `socat - UNIX-CONNECT:$XDG_RUNTIME_DIR/samsung-book-support.sock`.
+ */
+static void metrics_start()
+{
+	GSocketAddress *address;
+	GError *error = NULL;
+	const gchar *path;
+	GStatBuf st;
+
+	path = g_getenv(METRICS_SOCKET_ENV);
+	if (path != NULL)
+		metrics_socket = g_strdup(path);
+	else
+		metrics_socket = g_build_filename(g_get_user_runtime_dir(), METRICS_SOCKET_NAME, NULL);
+
+	// Stale socket from a previous run, never remove anything else
+	if (g_lstat(metrics_socket, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode) || st.st_uid != getuid()) {
+			metrics.errors[METRICS_ERROR_METRICS_LISTEN]++;
+			g_warning ("Not replacing %s, it is not a socket owned by the current user", metrics_socket);
+			return;
+		}
+
+		g_unlink(metrics_socket);
+	}
+
+	metrics_service = g_socket_service_new();
+	address = g_unix_socket_address_new(metrics_socket);
+
+	if (!g_socket_listener_add_address(G_SOCKET_LISTENER(metrics_service), address,
+										G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+										NULL, NULL, &error)) {
+		metrics.errors[METRICS_ERROR_METRICS_LISTEN]++;
+		g_warning ("Failed to listen on metrics socket %s: %s", metrics_socket, error->message);
 		g_error_free (error);
+		g_clear_object(&metrics_service);
 		goto out;
 	}
 
-	g_io_add_watch(channel, G_IO_IN, libevdev_event_handler, NULL);
+	g_signal_connect(metrics_service, "incoming", G_CALLBACK(metrics_incoming_handler), NULL);
+	g_socket_service_start(metrics_service);
+
+out:
+	g_object_unref(address);
+}
+
+static void metrics_stop()
+{
+	if (metrics_service != NULL) {
+		g_socket_service_stop(metrics_service);
+		g_clear_object(&metrics_service);
+		g_unlink(metrics_socket);
+	}
+
+	g_free(metrics_socket);
+}
+
+void application_activate_handler()
+{
+	const gchar *subsystems[] = {"input", NULL};
+	GList *devices, *l;
+
+	keyboards = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, keyboard_free);
+
+	// Hotplugged keyboards are handled one by one from the monitor
+	udev = g_udev_client_new(subsystems);
+	g_signal_connect(udev, "uevent", G_CALLBACK(udev_uevent_handler), NULL);
+
+	devices = g_udev_client_query_by_subsystem(udev, "input");
+	for (l = devices; l != NULL; l = l->next) {
+		if (keyboard_match(l->data))
+			keyboard_add(l->data);
+	}
+	g_list_free_full(devices, g_object_unref);
+
+	metrics_start();
+
+	if (g_hash_table_size(keyboards) == 0)
+		g_message ("No matching keyboard input yet, waiting for hotplug");
 
 	// Connect to upower daemon
 	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
@@ -151,15 +623,6 @@ void application_activate_handler()
 								NULL,
 								power_keyboard_proxy_ready_cb,
 								NULL);
-
-	return;
-
-out:
-	if (channel != NULL)
-		g_io_channel_unref(channel);
-
-	// Exit
-	g_application_release(app);
 }
 
 int main(int argc, char *argv[])
@@ -171,6 +634,13 @@ int main(int argc, char *argv[])
 	g_signal_connect(app, "activate", application_activate_handler, NULL);
 
 	status = g_application_run(app, argc, argv);
+
+	metrics_stop();
+
+	if (keyboards != NULL)
+		g_hash_table_destroy(keyboards);
+	if (udev != NULL)
+		g_object_unref(udev);
 	g_object_unref(app);
 	return status;
 }
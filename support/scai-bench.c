@@ -0,0 +1,570 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/vfs.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Concurrent stress and throughput tool for the samsung_acpi sysfs attributes
+ * and keyboard backlight LED.
+ *
+ * N threads pick a random operation from the configured mix, open the file,
+ * read or write it and close it again, as UPower, an LED trigger or a shell
+ * script would. At the end, the tool reports throughput and latency percentiles
+ * per operation, plus the reads that returned a value that was neither there
+ * before the run nor written during it (torn output, garbage). With a single
+ * writer (-s, or one thread), the writer also checks that it reads back what it
+ * wrote last: a mismatch is a stale read, e.g. a cached value overwritten by a
+ * firmware read that started before the write.
+ *
+ * The paths can be changed, so the tool also runs against a plain directory of
+ * files to get a baseline of its own overhead. Plain files are written to a
+ * temporary file renamed over the target, so that readers never see one half
+ * written or truncated, as sysfs guarantees for the real attributes.
+ */
+
+#define DEFAULT_ROOT		"/sys/bus/acpi/devices/SAM0428:00"
+#define DEFAULT_LED			"/sys/class/leds/scai::kbd_backlight"
+
+#define NSEC_PER_SEC		1000000000ULL
+#define VALUE_LEN			32
+
+#define SYSFS_MAGIC			0x62656572
+
+#define PROFILE_CHOICES		"/sys/firmware/acpi/platform_profile_choices"
+#define PERF_MODES			4
+
+enum op_type {
+	OP_READ,
+	OP_WRITE,
+	OP_TYPES
+};
+
+struct target {
+	const char *name;
+	const char *file;
+	int led;
+	// Valid values, either the names or the numbers from min to max
+	const char * const *names;
+	int min;
+	int max;
+	// Values written by the write operations
+	const char * const *writes;
+	char path[256];
+	int plain;
+	char saved[VALUE_LEN];
+	unsigned int weight[OP_TYPES];
+};
+
+static const char * const perf_mode_names[] = {"optimized", "performance", "quiet", "silent", NULL};
+// Filled at startup with the modes the machine supports
+static const char *perf_mode_writes[PERF_MODES + 1];
+static const char * const bool_writes[] = {"0", "1", NULL};
+static const char * const battery_life_extender_writes[] = {"0", "80", NULL};
+static const char * const brightness_writes[] = {"0", "1", "2", "3", NULL};
+
+static struct target targets[] = {
+	{"perf_mode", "perf_mode", 0, perf_mode_names, 0, 0, perf_mode_writes},
+	{"webcam_enable", "webcam_enable", 0, NULL, 0, 1, bool_writes},
+	{"autoboot", "autoboot", 0, NULL, 0, 1, bool_writes},
+	{"battery_life_extender", "battery_life_extender", 0, NULL, 0, 99, battery_life_extender_writes},
+	{"brightness", "brightness", 1, NULL, 0, 3, brightness_writes},
+};
+
+#define TARGETS				(sizeof(targets) / sizeof(targets[0]))
+
+struct samples {
+	unsigned long long *ns;
+	size_t count;
+	size_t size;
+	unsigned long errors;
+	unsigned long inconsistent;
+	unsigned long stale;
+};
+
+struct worker {
+	pthread_t thread;
+	unsigned int id;
+	unsigned int seed;
+	int writer;
+	// Last value written by this worker, when the write went through
+	const char *last[TARGETS];
+	struct samples samples[TARGETS][OP_TYPES];
+};
+
+static volatile int running = 1;
+static unsigned int total_weight;
+static int single_writer;
+
+static const char *op_names[OP_TYPES] = {"read", "write"};
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int samples_add(struct samples *s, unsigned long long ns)
+{
+	if (s->count == s->size) {
+		s->size = s->size ? s->size * 2 : 4096;
+		s->ns = realloc(s->ns, s->size * sizeof(*s->ns));
+		if (s->ns == NULL)
+			return -1;
+	}
+
+	s->ns[s->count++] = ns;
+
+	return 0;
+}
+
+static int read_value(const char *path, char *value)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	len = read(fd, value, VALUE_LEN - 1);
+	close(fd);
+
+	if (len < 0)
+		return -1;
+
+	value[len] = 0;
+	if (len > 0 && value[len - 1] == '\n')
+		value[len - 1] = 0;
+
+	return 0;
+}
+
+/*
+ * A sysfs attribute takes the whole value in one write, the offset and size of
+ * the file don't matter. tmp is only used for plain files.
+ */
+static int write_value(const struct target *t, const char *tmp, const char *value)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open(t->plain ? tmp : t->path, t->plain ? O_WRONLY | O_CREAT | O_TRUNC : O_WRONLY, 0644);
+	if (fd < 0)
+		return -1;
+
+	len = write(fd, value, strlen(value));
+	close(fd);
+
+	if (len != (ssize_t) strlen(value))
+		return -1;
+
+	if (t->plain && rename(tmp, t->path) != 0)
+		return -1;
+
+	return 0;
+}
+
+static int value_valid(const struct target *t, const char *value)
+{
+	const char * const *name;
+	char *end;
+	long n;
+
+	if (t->names) {
+		for (name = t->names; *name; name++) {
+			if (strcmp(*name, value) == 0)
+				return 1;
+		}
+
+		return 0;
+	}
+
+	n = strtol(value, &end, 10);
+
+	return *value && !*end && n >= t->min && n <= t->max;
+}
+
+/*
+ * The only values the file can hold during the run: the one it had before and
+ * the ones written to it.
+ */
+static int value_expected(const struct target *t, const char *value)
+{
+	const char * const *write;
+
+	if (strcmp(t->saved, value) == 0)
+		return 1;
+
+	if (!t->weight[OP_WRITE])
+		return 0;
+
+	for (write = t->writes; *write; write++) {
+		if (strcmp(*write, value) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long long start;
+	char value[VALUE_LEN], tmp[300];
+	const char *write;
+	unsigned int pick, i, op, nwrites;
+	struct target *t;
+	struct samples *s;
+	int err;
+
+	while (running) {
+		pick = rand_r(&w->seed) % total_weight;
+
+		for (i = 0; i < TARGETS; i++) {
+			for (op = 0; op < OP_TYPES; op++) {
+				if (pick < targets[i].weight[op])
+					goto found;
+				pick -= targets[i].weight[op];
+			}
+		}
+
+		continue;
+
+	found:
+		t = &targets[i];
+
+		if (op == OP_WRITE && !w->writer)
+			op = OP_READ;
+
+		s = &w->samples[i][op];
+
+		if (op == OP_READ) {
+			start = now_ns();
+			err = read_value(t->path, value);
+		} else {
+			for (nwrites = 0; t->writes[nwrites]; nwrites++)
+				;
+			write = t->writes[rand_r(&w->seed) % nwrites];
+
+			snprintf(tmp, sizeof(tmp), "%s.%u.tmp", t->path, w->id);
+
+			start = now_ns();
+			err = write_value(t, tmp, write);
+		}
+
+		if (samples_add(s, now_ns() - start) != 0) {
+			fprintf(stderr, "Out of memory\n");
+			running = 0;
+			break;
+		}
+
+		if (err)
+			s->errors++;
+
+		if (op == OP_WRITE)
+			w->last[i] = err ? NULL : write;
+		else if (err)
+			;
+		else if (!value_valid(t, value) || !value_expected(t, value))
+			s->inconsistent++;
+		else if (single_writer && w->writer && w->last[i] && strcmp(w->last[i], value) != 0)
+			s->stale++;
+	}
+
+	return NULL;
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *) a;
+	unsigned long long y = *(const unsigned long long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const struct samples *s, double p)
+{
+	size_t i = (size_t) (p * (s->count - 1));
+
+	return (double) s->ns[i] / 1000;
+}
+
+/*
+ * The mix is a comma separated list of NAME=READS[/WRITES] weights, e.g.
+ * perf_mode=4/1,brightness=8. Targets not listed are not touched.
+ */
+static int parse_mix(const char *mix)
+{
+	char *copy, *item, *save, *weights, *slash;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < TARGETS; i++)
+		targets[i].weight[OP_READ] = targets[i].weight[OP_WRITE] = 0;
+
+	copy = strdup(mix);
+
+	for (item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+		weights = strchr(item, '=');
+		if (weights == NULL) {
+			ret = -1;
+			break;
+		}
+		*weights++ = 0;
+
+		for (i = 0; i < TARGETS && strcmp(targets[i].name, item) != 0; i++)
+			;
+		if (i == TARGETS) {
+			fprintf(stderr, "Unknown target %s\n", item);
+			ret = -1;
+			break;
+		}
+
+		slash = strchr(weights, '/');
+		targets[i].weight[OP_READ] = strtoul(weights, NULL, 10);
+		targets[i].weight[OP_WRITE] = slash ? strtoul(slash + 1, NULL, 10) : 0;
+	}
+
+	free(copy);
+
+	return ret;
+}
+
+/*
+ * The perf_mode values to write, from -p or else from the platform profile
+ * choices, which the driver registers from the modes the firmware supports.
+ */
+static int perf_mode_setup(const char *modes)
+{
+	static const char * const profiles[][2] = {
+		{"balanced", "optimized"},
+		{"performance", "performance"},
+		{"quiet", "quiet"},
+		{"low-power", "silent"},
+	};
+	char choices[256], *copy, *item, *save;
+	unsigned int count = 0, i;
+	int ret = 0;
+
+	if (modes == NULL) {
+		if (read_value(PROFILE_CHOICES, choices) != 0)
+			strcpy(choices, "balanced performance");
+		modes = choices;
+	}
+
+	copy = strdup(modes);
+
+	for (item = strtok_r(copy, " ,", &save); item; item = strtok_r(NULL, " ,", &save)) {
+		for (i = 0; i < PERF_MODES; i++) {
+			if (strcmp(item, profiles[i][0]) == 0 || strcmp(item, profiles[i][1]) == 0)
+				break;
+		}
+
+		if (i == PERF_MODES) {
+			if (modes != choices) {
+				fprintf(stderr, "Unknown perf_mode %s\n", item);
+				ret = -1;
+				break;
+			}
+			continue;
+		}
+
+		if (count < PERF_MODES)
+			perf_mode_writes[count++] = profiles[i][1];
+	}
+
+	free(copy);
+
+	if (count == 0)
+		ret = -1;
+
+	return ret;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-t THREADS] [-d SECONDS] [-m MIX] [-s] [-p MODES] [-r ROOT] [-l LED]\n", name);
+	fprintf(stderr, "  -t  number of threads (default 4)\n");
+	fprintf(stderr, "  -d  duration in seconds (default 10)\n");
+	fprintf(stderr, "  -m  NAME=READS[/WRITES],... weights (default all targets, read only)\n");
+	fprintf(stderr, "      targets: perf_mode webcam_enable autoboot battery_life_extender brightness\n");
+	fprintf(stderr, "  -s  single writer: only the first thread writes and checks it reads back its writes\n");
+	fprintf(stderr, "  -p  perf_mode values to write, e.g. optimized,performance\n");
+	fprintf(stderr, "      (default from " PROFILE_CHOICES ")\n");
+	fprintf(stderr, "  -r  device directory (default " DEFAULT_ROOT ")\n");
+	fprintf(stderr, "  -l  LED directory (default " DEFAULT_LED ")\n");
+	fprintf(stderr, "Written values are restored at the end.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *root = DEFAULT_ROOT, *led = DEFAULT_LED, *perf_modes = NULL;
+	unsigned int threads = 4, duration = 10, i, j, op;
+	struct worker *workers;
+	struct samples merged;
+	struct statfs fs;
+	char tmp[300];
+	unsigned long long start, elapsed;
+	int opt, ret = 0;
+
+	for (i = 0; i < TARGETS; i++)
+		targets[i].weight[OP_READ] = 1;
+
+	while ((opt = getopt(argc, argv, "t:d:m:sp:r:l:h")) != -1) {
+		switch (opt) {
+			case 't':
+				threads = strtoul(optarg, NULL, 10);
+				break;
+			case 'd':
+				duration = strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				if (parse_mix(optarg) != 0) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 's':
+				single_writer = 1;
+				break;
+			case 'p':
+				perf_modes = optarg;
+				break;
+			case 'r':
+				root = optarg;
+				break;
+			case 'l':
+				led = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (threads == 0 || duration == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (threads == 1)
+		single_writer = 1;
+
+	if (perf_mode_setup(perf_modes) != 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < TARGETS; i++) {
+		snprintf(targets[i].path, sizeof(targets[i].path), "%s/%s", targets[i].led ? led : root, targets[i].file);
+
+		if (!targets[i].weight[OP_READ] && !targets[i].weight[OP_WRITE])
+			continue;
+
+		if (read_value(targets[i].path, targets[i].saved) != 0) {
+			fprintf(stderr, "Cannot read %s: %s\n", targets[i].path, strerror(errno));
+			return 1;
+		}
+
+		targets[i].plain = statfs(targets[i].path, &fs) == 0 && fs.f_type != SYSFS_MAGIC;
+
+		total_weight += targets[i].weight[OP_READ] + targets[i].weight[OP_WRITE];
+	}
+
+	if (total_weight == 0) {
+		fprintf(stderr, "Empty mix\n");
+		return 1;
+	}
+
+	workers = calloc(threads, sizeof(*workers));
+	if (workers == NULL)
+		return 1;
+
+	start = now_ns();
+
+	for (i = 0; i < threads; i++) {
+		workers[i].id = i;
+		workers[i].seed = start + i;
+		workers[i].writer = !single_writer || i == 0;
+		for (j = 0; j < TARGETS; j++)
+			workers[i].last[j] = targets[j].saved;
+		if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]) != 0) {
+			fprintf(stderr, "Cannot start thread %u\n", i);
+			running = 0;
+			threads = i;
+			ret = 1;
+			break;
+		}
+	}
+
+	if (running)
+		sleep(duration);
+	running = 0;
+
+	for (i = 0; i < threads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	elapsed = now_ns() - start;
+
+	printf("%u threads, %.2fs\n\n", threads, (double) elapsed / NSEC_PER_SEC);
+	printf("%-22s %-5s %10s %10s %10s %10s %10s %7s %7s %7s\n",
+		"target", "op", "ops", "ops/s", "p50 us", "p99 us", "p999 us", "errors", "invalid", "stale");
+
+	for (i = 0; i < TARGETS; i++) {
+		for (op = 0; op < OP_TYPES; op++) {
+			if (!targets[i].weight[op])
+				continue;
+
+			memset(&merged, 0, sizeof(merged));
+
+			for (j = 0; j < threads; j++) {
+				struct samples *s = &workers[j].samples[i][op];
+
+				merged.ns = realloc(merged.ns, (merged.count + s->count + 1) * sizeof(*merged.ns));
+				if (merged.ns == NULL)
+					return 1;
+
+				memcpy(merged.ns + merged.count, s->ns, s->count * sizeof(*s->ns));
+				merged.count += s->count;
+				merged.errors += s->errors;
+				merged.inconsistent += s->inconsistent;
+				merged.stale += s->stale;
+				free(s->ns);
+			}
+
+			qsort(merged.ns, merged.count, sizeof(*merged.ns), compare_ns);
+
+			printf("%-22s %-5s %10zu %10.0f", targets[i].name, op_names[op], merged.count,
+				(double) merged.count * NSEC_PER_SEC / elapsed);
+
+			if (merged.count)
+				printf(" %10.1f %10.1f %10.1f", percentile_us(&merged, 0.5),
+					percentile_us(&merged, 0.99), percentile_us(&merged, 0.999));
+			else
+				printf(" %10s %10s %10s", "-", "-", "-");
+
+			printf(" %7lu %7lu %7lu\n", merged.errors, merged.inconsistent, merged.stale);
+
+			if (merged.inconsistent || merged.stale)
+				ret = 1;
+
+			free(merged.ns);
+		}
+
+		snprintf(tmp, sizeof(tmp), "%s.tmp", targets[i].path);
+		if (targets[i].weight[OP_WRITE] && write_value(&targets[i], tmp, targets[i].saved) != 0)
+			fprintf(stderr, "Cannot restore %s to %s\n", targets[i].path, targets[i].saved);
+	}
+
+	free(workers);
+
+	return ret;
+}
@@ -0,0 +1,414 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../samsung_acpi_trace.h"
+
+/*
+ * Offline replayer for the SCAI traffic recorded by the driver in
+ * /sys/kernel/debug/samsung_acpi/trace.
+ *
+ * Every request of the trace is fed to a fake transport that answers like the
+ * firmware would from the state seen so far. The getter and setter pairs of the
+ * driver features are modelled: a set stores the value, which the matching get
+ * then returns. Other requests (handshakes, supported modes) are answered with
+ * the last response the firmware gave to the very same request bytes.
+ *
+ * When the recorded response differs from the fake one, the firmware state
+ * changed behind the driver's back (BIOS, hotkey, other OS) or the firmware did
+ * not do what it was asked, which is usually what has to be looked at when
+ * reproducing a bug.
+ */
+
+#define NSEC_PER_SEC		1000000000ULL
+#define NSEC_PER_USEC		1000ULL
+
+static const char *method_names[] = {
+	[SCAI_TRACE_CSFI] = "CSFI",
+	[SCAI_TRACE_CSXI] = "CSXI",
+	[SCAI_TRACE_SDLS] = "SDLS",
+	[SCAI_TRACE_SETM] = "SETM",
+};
+
+#define METHODS				(sizeof(method_names) / sizeof(method_names[0]))
+
+// Offset of the payload after safn, sasb and rflg, see struct scai_buffer
+#define SCAI_BUFFER_PAYLOAD	5
+
+struct fake_entry {
+	__u8 method;
+	__u16 len;
+	__u8 request[SCAI_TRACE_DATA_LEN];
+	__u8 response[SCAI_TRACE_DATA_LEN];
+};
+
+/*
+ * A getter and setter pair, told apart by the request bytes at the key
+ * offsets, see scai_features in the driver. The value is read at result in the
+ * get response and written at arg in the set request.
+ */
+struct fake_feature {
+	const char *name;
+	__u8 method;
+	struct {
+		__u8 offset;
+		__u8 get;
+		__u8 set;
+	} keys[5];
+	__u8 result;
+	__u8 arg;
+};
+
+// Offsets in struct scai_buffer
+#define SASB		2
+#define GUNM		5
+#define GUDS(i)		(6 + (i))
+#define FNCN		21
+#define SUBN		22
+#define IOB0		23
+
+static const struct fake_feature fake_features[] = {
+	{"kbd_backlight", SCAI_TRACE_CSFI,
+		{{SASB, 0x78, 0x78}, {SASB + 1, 0, 0}, {GUNM, 0x81, 0x82}}, GUNM, GUDS(0)},
+	{"battery_life_extender", SCAI_TRACE_CSFI,
+		{{SASB, 0x7a, 0x7a}, {SASB + 1, 0, 0}, {GUNM, 0x82, 0x82}, {GUDS(0), 0xe9, 0xe9}, {GUDS(1), 0x91, 0x90}},
+		GUDS(1), GUDS(2)},
+	{"autoboot", SCAI_TRACE_CSFI,
+		{{SASB, 0x7a, 0x7a}, {SASB + 1, 0, 0}, {GUNM, 0x82, 0x82}, {GUDS(0), 0xa3, 0xa3}, {GUDS(1), 0x81, 0x80}},
+		GUDS(1), GUDS(2)},
+	{"webcam_enable", SCAI_TRACE_CSFI,
+		{{SASB, 0x8a, 0x8a}, {SASB + 1, 0, 0}, {GUNM, 0x81, 0x82}}, GUNM, GUDS(0)},
+	{"perf_mode", SCAI_TRACE_CSXI,
+		{{SASB, 0x91, 0x91}, {SASB + 1, 0, 0}, {FNCN, 0x51, 0x51}, {SUBN, 0x02, 0x03}}, IOB0, IOB0},
+};
+
+#define FEATURES			(sizeof(fake_features) / sizeof(fake_features[0]))
+
+struct fake_transport {
+	struct fake_entry *entries;
+	size_t count;
+	size_t size;
+	// Modelled firmware state, per feature
+	__u8 value[FEATURES];
+	int known[FEATURES];
+};
+
+struct method_stats {
+	unsigned long count;
+	unsigned long failed;
+	__u64 latency_sum;
+	__u32 latency_min;
+	__u32 latency_max;
+};
+
+static __u64 now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void sleep_ns(__u64 ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / NSEC_PER_SEC;
+	ts.tv_nsec = ns % NSEC_PER_SEC;
+
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+/*
+ * The request and response of a complex method share the same buffer, so the
+ * response status byte (rflg) is not part of the request.
+ */
+static struct fake_entry *fake_lookup(struct fake_transport *t, const struct scai_trace_record *rec)
+{
+	size_t i;
+
+	for (i = 0; i < t->count; i++) {
+		if (t->entries[i].method == rec->method &&
+		    t->entries[i].len == rec->len &&
+		    memcmp(t->entries[i].request, rec->request, rec->len) == 0)
+			return &t->entries[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Finds the modelled feature of a request, with the key bytes of its getter or
+ * setter. Returns -1 when the request is not a modelled one.
+ */
+static int fake_classify(const struct scai_trace_record *rec, int *set)
+{
+	const struct fake_feature *f;
+	size_t i, k;
+	int get_match, set_match;
+
+	for (i = 0; i < FEATURES; i++) {
+		f = &fake_features[i];
+		if (f->method != rec->method)
+			continue;
+
+		get_match = set_match = 1;
+		for (k = 0; k < sizeof(f->keys) / sizeof(f->keys[0]) && f->keys[k].offset; k++) {
+			get_match &= rec->request[f->keys[k].offset] == f->keys[k].get;
+			set_match &= rec->request[f->keys[k].offset] == f->keys[k].set;
+		}
+
+		if (get_match || set_match) {
+			*set = !get_match;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Answers a request like the firmware would. A set updates the modelled state
+ * and a get returns it, in the response the firmware last gave to that get (or
+ * the recorded one, for the bytes that are not modelled). Returns -1 when the
+ * answer is not known yet.
+ */
+static int fake_evaluate(struct fake_transport *t, const struct scai_trace_record *rec, __u8 *response)
+{
+	const struct fake_feature *f;
+	struct fake_entry *entry;
+	int id, set = 0;
+
+	id = fake_classify(rec, &set);
+	f = id >= 0 ? &fake_features[id] : NULL;
+
+	if (f && set) {
+		t->value[id] = rec->request[f->arg];
+		t->known[id] = 1;
+	}
+
+	entry = fake_lookup(t, rec);
+
+	if (f && !set && t->known[id]) {
+		memcpy(response, entry ? entry->response : rec->response, rec->len);
+		response[f->result] = t->value[id];
+		return 0;
+	}
+
+	if (entry == NULL)
+		return -1;
+
+	memcpy(response, entry->response, entry->len);
+
+	return 0;
+}
+
+static int fake_learn(struct fake_transport *t, const struct scai_trace_record *rec)
+{
+	struct fake_entry *entry;
+	int id, set;
+
+	if (rec->status != SCAI_TRACE_OK)
+		return 0;
+
+	entry = fake_lookup(t, rec);
+	if (entry == NULL) {
+		if (t->count == t->size) {
+			t->size = t->size ? t->size * 2 : 64;
+			t->entries = realloc(t->entries, t->size * sizeof(*t->entries));
+			if (t->entries == NULL)
+				return -1;
+		}
+
+		entry = &t->entries[t->count++];
+		entry->method = rec->method;
+		entry->len = rec->len;
+		memcpy(entry->request, rec->request, rec->len);
+	}
+
+	memcpy(entry->response, rec->response, rec->len);
+
+	// Follow the real firmware from here, once a divergence was reported
+	id = fake_classify(rec, &set);
+	if (id >= 0 && !set) {
+		t->value[id] = rec->response[fake_features[id].result];
+		t->known[id] = 1;
+	}
+
+	return 0;
+}
+
+static void print_bytes(const __u8 *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		printf(" %02x", buf[i]);
+}
+
+static void print_record(const struct scai_trace_record *rec, __u64 first_ns, const char *outcome)
+{
+	const __u8 *req = rec->request;
+	size_t shown;
+
+	printf("%8llu %12.6f %s %-6s %8.3fms",
+		(unsigned long long) rec->seq,
+		(double) (rec->timestamp_ns - first_ns) / NSEC_PER_SEC,
+		method_names[rec->method],
+		rec->status == SCAI_TRACE_OK ? "ok" : "FAILED",
+		(double) rec->latency_ns / (NSEC_PER_SEC / 1000));
+
+	if (rec->len == 0) {
+		printf(" arg 0x%llx\n", (unsigned long long) rec->arg);
+		return;
+	}
+
+	shown = rec->len < SCAI_BUFFER_PAYLOAD + 4 ? rec->len : SCAI_BUFFER_PAYLOAD + 4;
+
+	printf(" sasb 0x%02x%02x req", req[3], req[2]);
+	print_bytes(req + SCAI_BUFFER_PAYLOAD, shown - SCAI_BUFFER_PAYLOAD);
+	printf(" rflg 0x%02x resp", rec->response[4]);
+	print_bytes(rec->response + SCAI_BUFFER_PAYLOAD, shown - SCAI_BUFFER_PAYLOAD);
+	printf("%s%s\n", *outcome ? " " : "", outcome);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-t] [-q] TRACE\n", name);
+	fprintf(stderr, "  -t  reproduce the recorded timing (gaps and firmware latency)\n");
+	fprintf(stderr, "  -q  only print the summary\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct fake_transport transport = {0};
+	struct method_stats stats[METHODS] = {0};
+	struct scai_trace_record rec;
+	__u8 response[SCAI_TRACE_DATA_LEN];
+	__u64 first_ns = 0, prev_ns = 0, next_seq = 0, replay_start = 0, elapsed;
+	unsigned long records = 0, lost = 0, learned = 0, matched = 0, diverged = 0;
+	char outcome[64];
+	int quiet = 0, timing = 0, opt, id, set;
+	size_t i;
+	FILE *trace;
+
+	while ((opt = getopt(argc, argv, "tqh")) != -1) {
+		switch (opt) {
+			case 't':
+				timing = 1;
+				break;
+			case 'q':
+				quiet = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	trace = fopen(argv[optind], "rb");
+	if (trace == NULL) {
+		fprintf(stderr, "Failed to open %s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, trace) == 1) {
+		if (rec.method >= METHODS || rec.len > SCAI_TRACE_DATA_LEN) {
+			fprintf(stderr, "Invalid record %llu, is this a trace?\n", (unsigned long long) rec.seq);
+			fclose(trace);
+			return 1;
+		}
+
+		if (records == 0) {
+			first_ns = prev_ns = rec.timestamp_ns;
+			replay_start = now_ns();
+		} else if (rec.seq > next_seq) {
+			lost += rec.seq - next_seq;
+		}
+
+		/*
+		 * Timestamps are the start of the calls, so waiting until the same
+		 * offset from the first one already covers the previous latency.
+		 * Then every call, integer or complex, takes as long as it did.
+		 */
+		if (timing) {
+			elapsed = now_ns() - replay_start;
+			if (rec.timestamp_ns > first_ns + elapsed)
+				sleep_ns(rec.timestamp_ns - first_ns - elapsed);
+			sleep_ns(rec.latency_ns);
+		}
+
+		next_seq = rec.seq + 1;
+		prev_ns = rec.timestamp_ns;
+		records++;
+
+		outcome[0] = 0;
+		id = rec.len ? fake_classify(&rec, &set) : -1;
+
+		if (rec.len == 0 || rec.status != SCAI_TRACE_OK) {
+			;
+		} else if (fake_evaluate(&transport, &rec, response) != 0) {
+			strcpy(outcome, "new");
+			learned++;
+		} else if (memcmp(response, rec.response, rec.len) == 0) {
+			matched++;
+		} else {
+			if (id >= 0 && !set)
+				snprintf(outcome, sizeof(outcome), "CHANGED %s expected 0x%02x",
+					fake_features[id].name, response[fake_features[id].result]);
+			else
+				strcpy(outcome, "CHANGED");
+			diverged++;
+		}
+
+		if (fake_learn(&transport, &rec) != 0) {
+			fprintf(stderr, "Out of memory\n");
+			fclose(trace);
+			return 1;
+		}
+
+		stats[rec.method].count++;
+		if (rec.status != SCAI_TRACE_OK)
+			stats[rec.method].failed++;
+		stats[rec.method].latency_sum += rec.latency_ns;
+		if (stats[rec.method].count == 1 || rec.latency_ns < stats[rec.method].latency_min)
+			stats[rec.method].latency_min = rec.latency_ns;
+		if (rec.latency_ns > stats[rec.method].latency_max)
+			stats[rec.method].latency_max = rec.latency_ns;
+
+		if (!quiet)
+			print_record(&rec, first_ns, outcome);
+	}
+
+	fclose(trace);
+
+	printf("\n%lu records, %lu lost, %.3fs\n", records, lost,
+		(double) (prev_ns - first_ns) / NSEC_PER_SEC);
+	printf("%lu requests answered for the first time, %lu replayed identically, %lu diverged\n",
+		learned, matched, diverged);
+
+	for (i = 0; i < METHODS; i++) {
+		if (!stats[i].count)
+			continue;
+
+		printf("%s: %lu calls, %lu failed, latency min/avg/max %.1f/%.1f/%.1fus\n",
+			method_names[i], stats[i].count, stats[i].failed,
+			(double) stats[i].latency_min / NSEC_PER_USEC,
+			(double) stats[i].latency_sum / stats[i].count / NSEC_PER_USEC,
+			(double) stats[i].latency_max / NSEC_PER_USEC);
+	}
+
+	free(transport.entries);
+
+	return 0;
+}